@@ -9,6 +9,29 @@ using namespace std;
 #define MAX_LOADSTRING 100
 
 class ChartData;
+class GdiCache;
+
+/// <summary>
+/// 表格的内存占用（字节），按类别统计，只统计本进程堆上的数据，不包括GDI对象在系统中的占用
+/// </summary>
+struct ChartMemoryStats {
+    size_t Values = 0;//Bar的数值
+    size_t Text = 0;//Bar文本、Unit文本与坐标轴名称
+    size_t Colors = 0;//Bar的颜色
+    size_t Legend = 0;//图例
+    size_t Caches = 0;//GdiCache中的字体、文本与文本尺寸
+    size_t Layout = 0;//表格与Unit对象本身及其指针
+    size_t Bars = 0;//Bar的个数
+
+    size_t Total() const { return Values + Text + Colors + Legend + Caches + Layout; }
+    double BytesPerBar() const { return Bars ? (double)Total() / Bars : 0; }
+};
+
+//字符串在堆上占用的字节数，短字符串存放在对象内部时为0
+inline size_t StringHeapBytes(const string& Str) {
+    static const size_t InlineCapacity = string().capacity();
+    return Str.capacity() > InlineCapacity ? Str.capacity() + 1 : 0;
+}
 
 class UnitData {
     friend ChartData;
@@ -91,7 +114,7 @@ public:
     /// 获取所有Bar的数据
     /// </summary>
     /// <returns>一个vector<int>，包含所有Bar的数据</returns>
-    vector<int> GetBarData() const { return this->EachBarData; }
+    const vector<int>& GetBarData() const { return this->EachBarData; }
 
     /// <summary>
     /// 获取所有Bar的颜色数据
@@ -126,8 +149,9 @@ public:
     /// <returns>bool类型: [true]成功, [false]失败</returns>
     bool InsertUnit(UnitData& Data) {
         if (Data.X < 0) return false;
-        this->Units.emplace_back(move(Data));
+        this->Units.emplace_back(make_shared<const UnitData>(move(Data)));//插入后不再修改，快照之间共享
         this->UpdataChar();
+        this->Version++;
         return true;
     }
 
@@ -155,37 +179,48 @@ public:
         if (hFont != NULL)
             this->hFont_Axis = hFont;
 
-        if (!Data.empty())
-            Units.insert(Units.end(), Data.begin(), Data.end());
+        for (auto& Unit : Data)
+            Units.emplace_back(make_shared<const UnitData>(move(Unit)));
 
         this->YNEnableSample = _EnableSample;
 
         this->SampleRect = _SampleRect;
 
+        this->Version++;
         return;
     }
 
     void EnableSample(bool f) {
         this->YNEnableSample = f;
+        this->Version++;
+    }
+
+    /// <summary>
+    /// 设置是否剔除相互重叠的文本（保留数值较大的Bar的文本），默认开启
+    /// </summary>
+    /// <param name="f">：[true]开，[false]关</param>
+    void EnableLabelCulling(bool f) {
+        this->YNCullLabels = f;
+        this->Version++;
     }
 
     /// <summary>
     /// 设置X轴的单位
     /// </summary>
     /// <param name="Unit">：整数</param>
-    void SetXUnit(int Unit) { this->X_Unit = Unit; }
+    void SetXUnit(int Unit) { this->X_Unit = Unit; this->Version++; }
 
     /// <summary>
     /// 设置Y轴的单位
     /// </summary>
     /// <param name="Unit">：整数</param>
-    void SetYUnit(int Unit) { this->Y_Unit = Unit; }
+    void SetYUnit(int Unit) { this->Y_Unit = Unit; this->Version++; }
 
     /// <summary>
     /// 设置图例的显示区域
     /// </summary>
     /// <param name="rect">：仅使用left和top</param>
-    void SetSampleRect(RECT rect) { this->SampleRect = rect; }
+    void SetSampleRect(RECT rect) { this->SampleRect = rect; this->Version++; }
 
     /// <summary>
     /// 获取X轴坐标长度，坐标长度自动生成，由Bar和Unit的数量的坐标决定
@@ -222,7 +257,21 @@ public:
     /// </summary>
     /// <param name="i">：当填写时，保证[0 &lt; i &lt; size]</param>
     /// <returns></returns>
-    UnitData GetUnitData(int i) const { return this->Units[i]; }
+    UnitData GetUnitData(int i) const {
+        UnitData Unit = *this->Units[i];
+        if (IsCompactUnit(i)) {//紧凑模式下还原Bar文本，使返回的Unit可以独立使用
+            for (int j = 0; j < Unit.EachBarData.size(); j++)
+                Unit.EachBarText.emplace_back(this->BarText(i, j));
+        }
+        return Unit;
+    }
+
+    /// <summary>
+    /// 获取指定Unit的只读引用，不复制数据（紧凑模式下其中没有Bar文本）
+    /// </summary>
+    /// <param name="i">：保证[0 &lt;= i &lt; size]</param>
+    /// <returns></returns>
+    const UnitData& GetUnit(int i) const { return *this->Units[i]; }
 
     /// <summary>
     /// 获取X轴的名称
@@ -260,30 +309,130 @@ public:
     /// <returns></returns>
     bool IsSampleEnable() const { return this->YNEnableSample; }
 
+    /// <summary>
+    /// 检查文本剔除是否启用
+    /// </summary>
+    /// <returns></returns>
+    bool IsLabelCullingEnable() const { return this->YNCullLabels; }
+
     /// <summary>
     /// 获取所有的图例
     /// </summary>
     /// <returns></returns>
     vector<pair<COLORREF, string>> GetSamples() const { return this->Samples; }
 
+    /// <summary>
+    /// 获取数据版本号，每次修改表格后递增，用于判断是否需要重绘
+    /// </summary>
+    /// <returns></returns>
+    unsigned long long GetVersion() const { return this->Version; }
+
+    /// <summary>
+    /// 统计表格的内存占用。与快照共享的Unit会在每个表格中重复计算
+    /// </summary>
+    /// <param name="Cache">：同时统计的GDI资源缓存，可以为NULL</param>
+    /// <returns></returns>
+    ChartMemoryStats MemoryStats(const GdiCache* Cache = NULL) const;
+
+    /// <summary>
+    /// 压缩存储：Bar文本改为图例的下标（相同的文本只保存一份），并释放所有vector与string的多余容量。
+    /// 压缩不影响绘制结果，之后仍可继续InsertUnit
+    /// </summary>
+    void ShrinkToFit() {
+        unordered_map<string, unsigned int> TextId;//文本 -> 图例下标
+        for (unsigned int i = 0; i < Samples.size(); i++)
+            TextId.emplace(Samples[i].second, i);
+
+        auto Packed = make_shared<CompactText>();
+        Packed->Offset.reserve(Units.size());
+        for (size_t u = 0; u < Units.size(); u++) {
+            const UnitData& Unit = *Units[u];
+            unsigned int Offset = (unsigned int)Packed->Ids.size();
+            bool AllFound = true;
+            for (int i = 0; i < Unit.EachBarData.size() && AllFound; i++) {
+                auto it = TextId.find(BarText(u, i));
+                if (it == TextId.end()) AllFound = false;
+                else Packed->Ids.emplace_back(it->second);
+            }
+            if (!AllFound) {//文本不在图例中（未经InsertUnit插入），保留原文本
+                Packed->Ids.resize(Offset);
+                Packed->Offset.emplace_back(CompactText::NoText);
+            }
+            else Packed->Offset.emplace_back(Offset);
+        }
+        Packed->Ids.shrink_to_fit();
+
+        //只重建文本存储方式改变或有多余容量的Unit，其余Unit继续与已发布的快照共享
+        for (size_t u = 0; u < Units.size(); u++) {
+            const UnitData& Old = *Units[u];
+            const bool ToCompact = Packed->Offset[u] != CompactText::NoText;
+            const bool TextChanged = ToCompact ? !Old.EachBarText.empty() : IsCompactUnit(u);
+            const bool Slack = Old.EachBarData.capacity() != Old.EachBarData.size()
+                || Old.EachBarColor.capacity() != Old.EachBarColor.size()
+                || Old.EachBarText.capacity() != Old.EachBarText.size();
+            if (!TextChanged && !Slack) continue;
+
+            UnitData Unit;
+            Unit.X = Old.X;
+            Unit.Text = Old.Text;
+            Unit.EachBarData = Old.EachBarData;//复制时容量即为大小
+            Unit.EachBarColor = Old.EachBarColor;
+            if (!ToCompact) {
+                Unit.EachBarText.reserve(Old.EachBarData.size());
+                for (int i = 0; i < Old.EachBarData.size(); i++)
+                    Unit.EachBarText.emplace_back(BarText(u, i));//按压缩前的方式读取
+            }
+            Units[u] = make_shared<const UnitData>(move(Unit));
+        }
+        this->Compact = Packed;
+
+        Units.shrink_to_fit();
+        Samples.shrink_to_fit();
+        for (auto& Sample : Samples) Sample.second.shrink_to_fit();
+        X_Name.shrink_to_fit();
+        Y_Name.shrink_to_fit();
+    }
+
 private:
+    /// <summary>
+    /// 紧凑模式下的Bar文本：所有压缩过的Unit的Bar文本依次排列为图例的下标，Unit本身不保存
+    /// </summary>
+    struct CompactText {
+        enum : unsigned int { NoText = 0xFFFFFFFF };
+        vector<unsigned int> Ids;//图例的下标
+        vector<unsigned int> Offset;//每个Unit的第一个Bar在Ids中的位置，NoText为未压缩；压缩之后插入的Unit不在其中
+    };
+
+    //指定Unit的Bar文本是否保存在Compact中
+    bool IsCompactUnit(size_t Unit) const {
+        return Compact && Unit < Compact->Offset.size() && Compact->Offset[Unit] != CompactText::NoText;
+    }
+
+    /// <summary>
+    /// 获取指定Unit中指定Bar的文本，兼容紧凑模式
+    /// </summary>
+    const string& BarText(size_t Unit, int i) const {
+        if (!IsCompactUnit(Unit)) return Units[Unit]->EachBarText[i];
+        return this->Samples[Compact->Ids[Compact->Offset[Unit] + i]].second;
+    }
+
     /// <summary>
     /// 用于更新坐标轴的长度
     /// </summary>
     inline void UpdataChar() {
         int LastUnitXPos = 0;
         size_t Cnt = 0;
-        for (auto Unit : Units) {
-            if (Unit.X > LastUnitXPos) {
-                LastUnitXPos = Unit.X;
-                Cnt = Unit.EachBarData.size();
+        for (auto& Unit : Units) {
+            if (Unit->X > LastUnitXPos) {
+                LastUnitXPos = Unit->X;
+                Cnt = Unit->EachBarData.size();
             }
         }
         this->X_Axis_Length = LastUnitXPos + 3 * BarWidth * this->X_Unit * Cnt;
 
         int LastUnitYPos = 0;
-        for (auto Unit : Units) {
-            for (auto Bar : Unit.EachBarData) {
+        for (auto& Unit : Units) {
+            for (auto Bar : Unit->EachBarData) {
                 LastUnitYPos = max(Bar, LastUnitYPos);
             }
         }
@@ -294,18 +443,20 @@ private:
             this->SampleRect.top = this->Y_Axis_Length + 10 / this->Y_Unit;
         }
 
-        for (auto Unit : Units) {
-            for (int i = 0; i < Unit.EachBarData.size(); i++) {
+        for (size_t u = 0; u < Units.size(); u++) {
+            const UnitData* Unit = Units[u].get();
+            for (int i = 0; i < Unit->EachBarData.size(); i++) {
+                const string& Text = BarText(u, i);
                 auto it = find_if(Samples.begin(), Samples.end(), 
-                    [Unit,i](pair<COLORREF,string> S) {return Unit.EachBarText[i] == S.second; });//查找是否有重复项已存在
+                    [&Text](const pair<COLORREF,string>& S) {return Text == S.second; });//查找是否有重复项已存在
                 if (it == Samples.end()) {//若没有
-                    Samples.emplace_back(pair<COLORREF, string>(Unit.EachBarColor[i], Unit.EachBarText[i]));//录入
+                    Samples.emplace_back(pair<COLORREF, string>(Unit->EachBarColor[i], Text));//录入
                 }
             }
         }
     }
 
-    vector<UnitData> Units;
+    vector<shared_ptr<const UnitData>> Units;//复制表格时只复制指针，Unit本身在各快照间共享
     int X_Axis_Length = 0;//坐标轴长度
     int X_Unit = 0;//单位
     int Y_Axis_Length = 0;
@@ -315,10 +466,269 @@ private:
     string X_Name = "";
     HFONT hFont_Axis = NULL;//所有文本的字体
     bool YNEnableSample = false;//是否绘制图例
+    bool YNCullLabels = true;//是否剔除重叠的文本
     RECT SampleRect = { 0,0,0,0 };//图例的显示区域，仅使用left和top，left和top分别代表距离起始点的长和高
     vector<pair<COLORREF, string>> Samples;//所有图例的颜色和文本
+    shared_ptr<const CompactText> Compact;//紧凑模式下的Bar文本，在各快照间共享
+    unsigned long long Version = 0;//数据版本号
+};
+
+/// <summary>
+/// GDI资源缓存，多个表格共享同一份字体、画笔、画刷、文本与文本尺寸，避免每次绘制都重复创建
+/// </summary>
+class GdiCache {
+public:
+    GdiCache() {}
+    GdiCache(const GdiCache&) = delete;
+    GdiCache& operator=(const GdiCache&) = delete;
+    ~GdiCache() { Clear(); }
+
+    /// <summary>
+    /// 获取字体，相同字体名与高度只创建一次
+    /// </summary>
+    /// <param name="Face">：字体名</param>
+    /// <param name="Height">：字体高度，0为默认</param>
+    /// <returns></returns>
+    HFONT GetFont(const wstring& Face, int Height = 0) {
+        auto Key = make_pair(Face, Height);
+        auto it = Fonts.find(Key);
+        if (it != Fonts.end()) return it->second;
+        HFONT hFont = CreateFont(Height, 0, 0, 0, 0, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, DEFAULT_QUALITY, DEFAULT_PITCH | FF_SWISS, Face.c_str());
+        Fonts.emplace(Key, hFont);
+        return hFont;
+    }
+
+    /// <summary>
+    /// 获取画笔
+    /// </summary>
+    /// <param name="Style">：画笔样式，如PS_SOLID</param>
+    /// <param name="Width">：画笔宽度</param>
+    /// <param name="Color">：画笔颜色</param>
+    /// <returns></returns>
+    HPEN GetPen(int Style, int Width, COLORREF Color) {
+        unsigned long long Key = ((unsigned long long)(Style & 0xFF) << 56) | ((unsigned long long)(Width & 0xFFFFFF) << 32) | Color;
+        auto it = Pens.find(Key);
+        if (it != Pens.end()) return it->second;
+        HPEN hPen = CreatePen(Style, Width, Color);
+        Pens.emplace(Key, hPen);
+        return hPen;
+    }
+
+    /// <summary>
+    /// 获取阴影画刷
+    /// </summary>
+    /// <param name="Hatch">：阴影样式，如HS_BDIAGONAL</param>
+    /// <param name="Color">：画刷颜色</param>
+    /// <returns></returns>
+    HBRUSH GetHatchBrush(int Hatch, COLORREF Color) {
+        unsigned long long Key = ((unsigned long long)(Hatch & 0xFF) << 32) | Color;
+        auto it = Brushes.find(Key);
+        if (it != Brushes.end()) return it->second;
+        HBRUSH hBrush = CreateHatchBrush(Hatch, Color);
+        Brushes.emplace(Key, hBrush);
+        return hBrush;
+    }
+
+    /// <summary>
+    /// 获取转换后的宽字符文本，代替str2LPWSTR，不会泄漏内存。
+    /// 数值文本（Bar的数值）种类没有上限，不进入缓存；其他文本按最近使用保留至多MaxTextCount个
+    /// </summary>
+    /// <param name="Str">：UTF-8字符串</param>
+    /// <returns>宽字符串的引用，仅在下一次调用GetText、GetTextExtent或Clear之前有效</returns>
+    const wstring& GetText(const string& Str) {
+        if (IsNumberText(Str)) {
+            Scratch = ToWide(Str);
+            return Scratch;
+        }
+        auto it = Texts.find(Str);
+        if (it != Texts.end()) {
+            TextOrder.splice(TextOrder.begin(), TextOrder, it->second.Order);//移到最近使用
+            return it->second.WStr;
+        }
+        if (Texts.size() >= MaxTextCount) {//淘汰最久未使用的一个
+            Texts.erase(TextOrder.back());
+            TextOrder.pop_back();
+        }
+        TextOrder.emplace_front(Str);
+        TextEntry Entry;
+        Entry.WStr = ToWide(Str);
+        Entry.Order = TextOrder.begin();
+        return Texts.emplace(Str, move(Entry)).first->second.WStr;
+    }
+
+    /// <summary>
+    /// 获取文本在指定字体下的尺寸（字形测量缓存）。数值文本由每个字体只测量一次的数字宽度相加得到，
+    /// 不调用GDI；字体已选入hdc时不再重复选入
+    /// </summary>
+    /// <param name="hdc">：用于测量的设备上下文</param>
+    /// <param name="hFont">：字体，NULL为设备上下文当前字体</param>
+    /// <param name="Str">：UTF-8字符串</param>
+    /// <returns></returns>
+    SIZE GetTextExtent(HDC hdc, HFONT hFont, const string& Str) {
+        const HGDIOBJ Current = GetCurrentObject(hdc, OBJ_FONT);
+        if (!hFont) hFont = (HFONT)Current;
+        if (IsNumberText(Str)) {
+            const DigitMetrics& Metrics = GetDigitMetrics(hdc, hFont, Current);
+            SIZE Size = { 0, Metrics.Height };
+            for (char c : Str) Size.cx += c == '-' ? Metrics.Minus : Metrics.Digit[c - '0'];
+            return Size;
+        }
+
+        auto Key = make_pair(hFont, Str);
+        auto it = Extents.find(Key);
+        if (it != Extents.end()) return it->second;
+        const wstring& WStr = GetText(Str);
+        const HGDIOBJ OldFont = hFont != Current ? SelectObject(hdc, hFont) : NULL;
+        SIZE Size = { 0,0 };
+        GetTextExtentPoint32(hdc, WStr.c_str(), (int)WStr.length(), &Size);
+        if (OldFont) SelectObject(hdc, OldFont);
+        if (Extents.size() >= MaxTextCount) Extents.clear();//返回的是值，整体丢弃不影响调用者
+        Extents.emplace(Key, Size);
+        return Size;
+    }
+
+    /// <summary>
+    /// 释放所有缓存的GDI对象与文本，调用前确保这些对象未被选入任何设备上下文
+    /// </summary>
+    void Clear() {
+        for (auto& Font : Fonts) DeleteObject(Font.second);
+        for (auto& Pen : Pens) DeleteObject(Pen.second);
+        for (auto& Brush : Brushes) DeleteObject(Brush.second);
+        Fonts.clear();
+        Pens.clear();
+        Brushes.clear();
+        Texts.clear();
+        TextOrder.clear();
+        Extents.clear();
+        Digits.clear();
+    }
+
+    /// <summary>
+    /// 估算缓存在堆上占用的字节数（按每个节点两个指针的开销估算，不包括GDI对象在系统中的占用）
+    /// </summary>
+    /// <returns></returns>
+    size_t MemoryBytes() const {
+        const size_t Node = 2 * sizeof(void*);
+        size_t Bytes = 0;
+        for (auto& Font : Fonts)
+            Bytes += Node + sizeof(Font) + (Font.first.first.capacity() + 1) * sizeof(wchar_t);
+        Bytes += (Pens.size() + Brushes.size()) * (Node + sizeof(unsigned long long) + sizeof(HGDIOBJ));
+        for (auto& Text : Texts)
+            Bytes += 2 * Node + sizeof(Text) + 2 * StringHeapBytes(Text.first) + (Text.second.WStr.capacity() + 1) * sizeof(wchar_t);//含TextOrder中的节点
+        for (auto& Extent : Extents)
+            Bytes += Node + sizeof(Extent) + StringHeapBytes(Extent.first.second);
+        Bytes += Digits.size() * (Node + sizeof(pair<HFONT, DigitMetrics>));
+        return Bytes;
+    }
+
+private:
+    struct TextEntry {
+        wstring WStr;
+        list<string>::iterator Order;//在TextOrder中的位置
+    };
+
+    //是否为整数文本
+    static bool IsNumberText(const string& Str) {
+        if (Str.empty()) return false;
+        for (size_t i = 0; i < Str.size(); i++) {
+            if (Str[i] >= '0' && Str[i] <= '9') continue;
+            if (i == 0 && Str[i] == '-' && Str.size() > 1) continue;
+            return false;
+        }
+        return true;
+    }
+
+    static wstring ToWide(const string& Str) {
+        int wLen = MultiByteToWideChar(CP_UTF8, 0, Str.c_str(), (int)Str.length(), NULL, 0);
+        wstring WStr(wLen, L'\0');
+        if (wLen > 0)
+            MultiByteToWideChar(CP_UTF8, 0, Str.c_str(), (int)Str.length(), &WStr[0], wLen);
+        return WStr;
+    }
+
+    //字体中数字与负号的宽度，数值文本的宽度为各字符宽度之和（与GetTextExtentPoint32相同，不含字距调整）
+    struct DigitMetrics {
+        int Digit[10];
+        int Minus;
+        LONG Height;
+    };
+
+    const DigitMetrics& GetDigitMetrics(HDC hdc, HFONT hFont, HGDIOBJ Current) {
+        auto it = Digits.find(hFont);
+        if (it != Digits.end()) return it->second;
+        const HGDIOBJ OldFont = hFont != Current ? SelectObject(hdc, hFont) : NULL;
+        DigitMetrics Metrics;
+        GetCharWidth32(hdc, L'0', L'9', Metrics.Digit);
+        GetCharWidth32(hdc, L'-', L'-', &Metrics.Minus);
+        SIZE Size = { 0,0 };
+        GetTextExtentPoint32(hdc, L"0", 1, &Size);
+        Metrics.Height = Size.cy;
+        if (OldFont) SelectObject(hdc, OldFont);
+        return Digits.emplace(hFont, Metrics).first->second;
+    }
+
+    //字形测量缓存的键的哈希
+    struct ExtentKeyHash {
+        size_t operator()(const pair<HFONT, string>& Key) const {
+            size_t Seed = hash<string>()(Key.second);
+            return Seed ^ (hash<HFONT>()(Key.first) + 0x9E3779B9 + (Seed << 6) + (Seed >> 2));
+        }
+    };
+
+    static const size_t MaxTextCount = 4096;//文本缓存上限
+    map<pair<wstring, int>, HFONT> Fonts;
+    unordered_map<unsigned long long, HPEN> Pens;
+    unordered_map<unsigned long long, HBRUSH> Brushes;
+    unordered_map<string, TextEntry> Texts;
+    list<string> TextOrder;//最近使用的文本在前
+    wstring Scratch;//不缓存的文本
+    unordered_map<pair<HFONT, string>, SIZE, ExtentKeyHash> Extents;
+    unordered_map<HFONT, DigitMetrics> Digits;//每个字体的数字宽度
 };
 
+ChartMemoryStats ChartData::MemoryStats(const GdiCache* Cache) const {
+    ChartMemoryStats Stats;
+    Stats.Layout = sizeof(ChartData) + Units.capacity() * sizeof(Units[0]);
+    for (auto& Unit : Units) {
+        Stats.Layout += sizeof(UnitData) + 2 * sizeof(void*);//make_shared的控制块
+        Stats.Bars += Unit->EachBarData.size();
+        Stats.Values += Unit->EachBarData.capacity() * sizeof(int);
+        Stats.Colors += Unit->EachBarColor.capacity() * sizeof(COLORREF);
+        Stats.Text += Unit->EachBarText.capacity() * sizeof(string);
+        for (auto& Str : Unit->EachBarText) Stats.Text += StringHeapBytes(Str);
+        Stats.Text += StringHeapBytes(Unit->Text);
+    }
+    Stats.Text += StringHeapBytes(X_Name) + StringHeapBytes(Y_Name);
+    if (Compact)
+        Stats.Text += sizeof(CompactText) + (Compact->Ids.capacity() + Compact->Offset.capacity()) * sizeof(unsigned int);
+    Stats.Legend = Samples.capacity() * sizeof(Samples[0]);
+    for (auto& Sample : Samples) Stats.Legend += StringHeapBytes(Sample.second);
+    if (Cache) Stats.Caches = Cache->MemoryBytes();
+    return Stats;
+}
+
+/// <summary>
+/// 压缩前后的内存占用
+/// </summary>
+struct ChartMemoryReport {
+    ChartMemoryStats Before;
+    ChartMemoryStats After;
+};
+
+/// <summary>
+/// 内存测试：统计表格的内存占用，再对其副本执行ShrinkToFit后重新统计，原表格不受影响
+/// </summary>
+/// <param name="Chart">：待测的表格</param>
+/// <returns></returns>
+ChartMemoryReport MeasureChartMemory(const ChartData& Chart) {
+    ChartMemoryReport Report;
+    Report.Before = Chart.MemoryStats();
+    ChartData Packed = Chart;//只复制Unit的指针，压缩时替换的是副本中的指针
+    Packed.ShrinkToFit();
+    Report.After = Packed.MemoryStats();
+    return Report;
+}
+
 // 全局变量:
 HINSTANCE hInst;                                // 当前实例
 WCHAR szTitle[MAX_LOADSTRING];                  // 标题栏文本
@@ -331,7 +741,7 @@ LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
 INT_PTR CALLBACK    About(HWND, UINT, WPARAM, LPARAM);
 LPWSTR              str2LPWSTR(string);
 string              LPWSTR2str(LPWSTR);
-void                DrawBarChart(HDC, POINT, ChartData, COLORREF);
+void                DrawBarChart(HDC, POINT, const ChartData&, COLORREF, GdiCache*, const RECT*);
 
 
 //字符串转 L长 P指针 W宽字符 STR字符串 (支持汉字)
@@ -353,84 +763,113 @@ string LPWSTR2str(LPWSTR lpwstr) {
     return lpstr;
 }
 
-//@brief 所有单位均使用对话框单位
-//@param hdc, StartPos, Data, Axis
-void DrawBarChart(HDC hdc, POINT StartPos, ChartData Data, COLORREF Axis = RGB(0, 0, 0)) {
-    const int BarWidth = Data.GetBarWidth();//获取Bar的宽度
+//表格中的一个矩形（Bar或图例色块）
+struct ChartBox {
+    RECT Rect;//像素
+    COLORREF Color;
+};
 
-    //将对话框模板转换为像素
-    StartPos.x = MulDiv(StartPos.x, LOWORD(GetDialogBaseUnits()), 4);
-    StartPos.y = MulDiv(StartPos.y, HIWORD(GetDialogBaseUnits()), 8);
+//表格中的一段文本
+struct ChartLabel {
+    RECT Box;//DrawText的文本框（像素）
+    RECT Ink;//文本实际占用的区域（不裁剪到文本框），由MeasureChartLabels计算
+    string Text;
+    UINT Format;//DrawText的格式
+    int Priority;//重叠时优先保留较大者
+    bool Always;//坐标轴与图例文本，始终绘制
+    bool Visible;//剔除后是否绘制
+};
 
-    //移动至起始位置
-    MoveToEx(hdc, StartPos.x, StartPos.y, NULL);
+//DrawBarChart的布局结果，所有坐标均为像素
+struct ChartLayout {
+    POINT Origin;//坐标轴原点
+    POINT XAxisEnd;
+    POINT YAxisEnd;
+    vector<ChartBox> Bars;
+    vector<ChartBox> SampleBoxes;//图例色块
+    vector<ChartLabel> Labels;
+};
 
-    HPEN AxisPen = CreatePen(PS_SOLID, 1, Axis);//创建并选择指定颜色的画笔
-    SelectObject(hdc, AxisPen);
+/// <summary>
+/// 计算表格的布局，不进行任何绘制
+/// </summary>
+/// <param name="Data">：表格数据</param>
+/// <param name="StartPos">：起始点（对话框单位）</param>
+/// <returns></returns>
+ChartLayout BuildChartLayout(const ChartData& Data, POINT StartPos) {
+    ChartLayout Layout;
+    const int BarWidth = Data.GetBarWidth();//获取Bar的宽度
+    const LONG BaseUnits = GetDialogBaseUnits();//对话框基本单位
+    const int BaseX = LOWORD(BaseUnits), BaseY = HIWORD(BaseUnits);
+
+    auto AddLabel = [&Layout](RECT Box, const string& Text, UINT Format, int Priority, bool Always) {
+        ChartLabel Label;
+        Label.Box = Box;
+        Label.Ink = Box;
+        Label.Text = Text;
+        Label.Format = Format;
+        Label.Priority = Priority;
+        Label.Always = Always;
+        Label.Visible = true;
+        Layout.Labels.emplace_back(move(Label));
+    };
 
-    //绘制坐标轴
-    LineTo(hdc, StartPos.x + MulDiv(Data.GetXAxisLength(), LOWORD(GetDialogBaseUnits()), 4), StartPos.y);//X
+    //将对话框模板转换为像素
+    StartPos.x = MulDiv(StartPos.x, BaseX, 4);
+    StartPos.y = MulDiv(StartPos.y, BaseY, 8);
 
-    MoveToEx(hdc, StartPos.x, StartPos.y, NULL);
-    LineTo(hdc, StartPos.x, StartPos.y - MulDiv(Data.GetYAxisLength(), HIWORD(GetDialogBaseUnits()), 8));//Y
+    //坐标轴
+    Layout.Origin = StartPos;
+    Layout.XAxisEnd = { StartPos.x + MulDiv(Data.GetXAxisLength(), BaseX, 4), StartPos.y };//X
+    Layout.YAxisEnd = { StartPos.x, StartPos.y - MulDiv(Data.GetYAxisLength(), BaseY, 8) };//Y
 
     //坐标轴文本
-    if (Data.GetAxisFont())//当字体已被设置时读取并应用字体
-        SelectObject(hdc, Data.GetAxisFont());
-
     RECT TextBox;//文本框
-    TextBox.left = StartPos.x + MulDiv(Data.GetXAxisLength(), LOWORD(GetDialogBaseUnits()), 4) - 100;
-    TextBox.right = StartPos.x + MulDiv(Data.GetXAxisLength(), LOWORD(GetDialogBaseUnits()), 4);
+    TextBox.left = Layout.XAxisEnd.x - 100;
+    TextBox.right = Layout.XAxisEnd.x;
     TextBox.top = StartPos.y + 5;
     TextBox.bottom = StartPos.y + 30;
-    DrawText(hdc, str2LPWSTR(Data.GetXName()), -1, &TextBox, DT_RIGHT | DT_TOP | DT_SINGLELINE);//X轴文本
+    AddLabel(TextBox, Data.GetXName(), DT_RIGHT | DT_TOP | DT_SINGLELINE, 0, true);//X轴文本
 
     TextBox.left = StartPos.x - 100;
     TextBox.right = StartPos.x - 5;
-    TextBox.top = StartPos.y - MulDiv(Data.GetYAxisLength(), HIWORD(GetDialogBaseUnits()), 8);
-    TextBox.bottom = StartPos.y - MulDiv(Data.GetYAxisLength(), HIWORD(GetDialogBaseUnits()), 8) + 20;
-    DrawText(hdc, str2LPWSTR(Data.GetYName()), -1, &TextBox, DT_RIGHT | DT_VCENTER | DT_SINGLELINE);//Y轴文本
+    TextBox.top = Layout.YAxisEnd.y;
+    TextBox.bottom = Layout.YAxisEnd.y + 20;
+    AddLabel(TextBox, Data.GetYName(), DT_RIGHT | DT_VCENTER | DT_SINGLELINE, 0, true);//Y轴文本
 
-    //绘制Bar
+    //Bar
     for (int i = 0; i < Data.GetUnitsCount(); i++) {
         //获取
-        UnitData Unit = Data.GetUnitData(i);//获取单个Unit的数据
-        vector<int> Bars = Unit.GetBarData();//获取所有的Bar的数据
+        const UnitData& Unit = Data.GetUnit(i);//获取单个Unit的数据
+        const vector<int>& Bars = Unit.GetBarData();//获取所有的Bar的数据
         //处理
         int BarCnt = Bars.size();//获取Bar的个数
         double Start_X = (double)BarCnt / 2;//计算起始点
         int ptr = 0;//Bar数据下标
+        int UnitPriority = 0;//Unit文本的优先级取其最大的Bar
 
         for (double j = -Start_X; j < Start_X; j++) {
             //计算坐标
             int X_Pos = Unit.GetXPos() / Data.GetXUnit() + BarWidth * j;//formula : 中心 / 单位 + 宽度 * 偏移量
-            int X_Pos_Pixel = StartPos.x + MulDiv(X_Pos, LOWORD(GetDialogBaseUnits()), 4);//转换为像素
+            int X_Pos_Pixel = StartPos.x + MulDiv(X_Pos, BaseX, 4);//转换为像素
 
             int Y_Pos = Bars[ptr] / Data.GetYUnit();//formula : 数据 / 单位
-            int Y_Pos_Pixel = StartPos.y - MulDiv(Y_Pos, HIWORD(GetDialogBaseUnits()), 8);//转换为像素
-
-            //进行
-            HPEN BarPen = CreatePen(PS_INSIDEFRAME, 1, Unit.GetBarColor(ptr));//获取当前Bar的颜色，如果存在
-            HPEN OldPen = (HPEN)SelectObject(hdc, BarPen);
-            DeleteObject(OldPen);
+            int Y_Pos_Pixel = StartPos.y - MulDiv(Y_Pos, BaseY, 8);//转换为像素
 
-            HBRUSH BarBrush = CreateHatchBrush(HS_BDIAGONAL, Unit.GetBarColor(ptr));
-            HBRUSH OldBrush = (HBRUSH)SelectObject(hdc, BarBrush);
-            DeleteObject(OldBrush);
-
-            RECT _Rectangle;
-            _Rectangle.left = X_Pos_Pixel;
-            _Rectangle.right = X_Pos_Pixel + MulDiv(BarWidth, LOWORD(GetDialogBaseUnits()), 4);
-            _Rectangle.top = Y_Pos_Pixel;
-            _Rectangle.bottom = StartPos.y;
-
-            Rectangle(hdc, _Rectangle.left, _Rectangle.top, _Rectangle.right, _Rectangle.bottom);
+            ChartBox Bar;
+            Bar.Rect.left = X_Pos_Pixel;
+            Bar.Rect.right = X_Pos_Pixel + MulDiv(BarWidth, BaseX, 4);
+            Bar.Rect.top = Y_Pos_Pixel;
+            Bar.Rect.bottom = StartPos.y;
+            Bar.Color = Unit.GetBarColor(ptr);//获取当前Bar的颜色，如果存在
+            Layout.Bars.emplace_back(Bar);
 
             RECT TextBox;
-            TextBox.left = _Rectangle.left + 1, TextBox.right = _Rectangle.right;
-            TextBox.top = _Rectangle.top - 20, TextBox.bottom = _Rectangle.top;
-            DrawText(hdc, str2LPWSTR(to_string(Bars[ptr])), -1, &TextBox, DT_CENTER | DT_VCENTER | DT_SINGLELINE);//Bar文本
+            TextBox.left = Bar.Rect.left + 1, TextBox.right = Bar.Rect.right;
+            TextBox.top = Bar.Rect.top - 20, TextBox.bottom = Bar.Rect.top;
+            AddLabel(TextBox, to_string(Bars[ptr]), DT_CENTER | DT_VCENTER | DT_SINGLELINE, Bars[ptr], false);//Bar文本
 
+            UnitPriority = ptr == 0 ? Bars[ptr] : max(UnitPriority, Bars[ptr]);
             ptr++;//Bar数据下标
         }
 
@@ -439,46 +878,1481 @@ void DrawBarChart(HDC hdc, POINT StartPos, ChartData Data, COLORREF Axis = RGB(0
         TextBox.right = Unit.GetXPos() / Data.GetXUnit() + BarWidth;
         TextBox.top = StartPos.y + 5, TextBox.bottom = StartPos.y + 30;
 
-        TextBox.left = StartPos.x + MulDiv(TextBox.left, LOWORD(GetDialogBaseUnits()), 4);
-        TextBox.right = StartPos.x + MulDiv(TextBox.right, LOWORD(GetDialogBaseUnits()), 4);
-        DrawText(hdc, str2LPWSTR(Unit.GetText()), -1, &TextBox, DT_CENTER | DT_VCENTER | DT_SINGLELINE);//Unit文本
+        TextBox.left = StartPos.x + MulDiv(TextBox.left, BaseX, 4);
+        TextBox.right = StartPos.x + MulDiv(TextBox.right, BaseX, 4);
+        AddLabel(TextBox, Unit.GetText(), DT_CENTER | DT_VCENTER | DT_SINGLELINE, UnitPriority, false);//Unit文本
     }
 
-    //绘制图例
-    if (!Data.IsSampleEnable()) return;//判断是否需要绘制图例
+    //图例
+    if (!Data.IsSampleEnable()) return Layout;//判断是否需要绘制图例
     RECT Rect = Data.GetSampleRect();
-    Rect.left = MulDiv(Rect.left, LOWORD(GetDialogBaseUnits()), 4);
-    Rect.top = MulDiv(Rect.top, HIWORD(GetDialogBaseUnits()), 8);
+    Rect.left = MulDiv(Rect.left, BaseX, 4);
+    Rect.top = MulDiv(Rect.top, BaseY, 8);
     Rect.left += StartPos.x;
     Rect.top = StartPos.y - Rect.top;
 
     const int SampleLength = (double)BarWidth / 2;
 
     int Cnt = 0;//已处理的个数
-    for (auto Sample : Data.GetSamples()) {
-        HPEN BarPen = CreatePen(PS_INSIDEFRAME, 1, Sample.first);//获取当前Sample的颜色，如果存在
-        HPEN OldPen = (HPEN)SelectObject(hdc, BarPen);
-        DeleteObject(OldPen);
+    for (auto& Sample : Data.GetSamples()) {
+        ChartBox SingleRect;
+        SingleRect.Rect.left = Rect.left;
+        SingleRect.Rect.top = Rect.top + Cnt * MulDiv(SampleLength * 2, BaseY, 8);
+        SingleRect.Rect.right = Rect.left + MulDiv(SampleLength, BaseX, 4);
+        SingleRect.Rect.bottom = SingleRect.Rect.top + MulDiv(SampleLength, BaseY, 8);
+        SingleRect.Color = Sample.first;
+        Layout.SampleBoxes.emplace_back(SingleRect);
 
-        HBRUSH BarBrush = CreateHatchBrush(HS_BDIAGONAL, Sample.first);
-        HBRUSH OldBrush = (HBRUSH)SelectObject(hdc, BarBrush);
-        DeleteObject(OldBrush);
+        RECT TextBox;
+        TextBox.left = SingleRect.Rect.right + 20, TextBox.right = SingleRect.Rect.right + 128;
+        TextBox.top = SingleRect.Rect.top, TextBox.bottom = SingleRect.Rect.top + 20;
+        AddLabel(TextBox, Sample.second, DT_LEFT | DT_VCENTER | DT_SINGLELINE, 0, true);//Sample文本
 
-        RECT SingleRect;
-        SingleRect.left = Rect.left;
-        SingleRect.top = Rect.top + Cnt * MulDiv(SampleLength * 2, HIWORD(GetDialogBaseUnits()), 8);
-        SingleRect.right = Rect.left + MulDiv(SampleLength, LOWORD(GetDialogBaseUnits()), 4);
-        SingleRect.bottom = SingleRect.top + MulDiv(SampleLength, HIWORD(GetDialogBaseUnits()), 8);
+        Cnt++;
+    }
+    return Layout;
+}
 
-        Rectangle(hdc, SingleRect.left, SingleRect.top, SingleRect.right, SingleRect.bottom);
+//布局中所有坐标轴、矩形与文本框的外接矩形（像素）
+RECT ChartLayoutBounds(const ChartLayout& Layout) {
+    RECT Bounds = { Layout.Origin.x, Layout.YAxisEnd.y, Layout.XAxisEnd.x, Layout.Origin.y };
+    auto Extend = [&Bounds](const RECT& Rect) {
+        Bounds.left = min(Bounds.left, Rect.left);
+        Bounds.top = min(Bounds.top, Rect.top);
+        Bounds.right = max(Bounds.right, Rect.right);
+        Bounds.bottom = max(Bounds.bottom, Rect.bottom);
+    };
+    for (auto& Bar : Layout.Bars) Extend(Bar.Rect);
+    for (auto& Box : Layout.SampleBoxes) Extend(Box.Rect);
+    for (auto& Label : Layout.Labels) Extend(Label.Box);
+    return Bounds;
+}
 
-        RECT TextBox;
-        TextBox.left = SingleRect.right + 20, TextBox.right = SingleRect.right + 128;
-        TextBox.top = SingleRect.top, TextBox.bottom = SingleRect.top + 20;
-        DrawText(hdc, str2LPWSTR(Sample.second), -1, &TextBox, DT_LEFT | DT_VCENTER | DT_SINGLELINE);//Sample文本
+/// <summary>
+/// 按当前选入hdc的字体计算每段文本实际占用的区域。区域不裁剪到文本框：比文本框宽的数值
+/// 若被裁剪，相邻的残片互不重叠而无法剔除，因此剔除后以DT_NOCLIP绘制，绘制结果与该区域一致
+/// </summary>
+/// <param name="hdc">：设备上下文</param>
+/// <param name="hFont">：绘制时使用的字体，NULL为设备上下文当前字体</param>
+/// <param name="Labels">：BuildChartLayout生成的文本</param>
+/// <param name="Res">：缓存文本尺寸</param>
+void MeasureChartLabels(HDC hdc, HFONT hFont, vector<ChartLabel>& Labels, GdiCache& Res) {
+    for (auto& Label : Labels) {
+        SIZE Size = Res.GetTextExtent(hdc, hFont, Label.Text);
+        RECT Ink;
+        if (Label.Format & DT_CENTER) Ink.left = (Label.Box.left + Label.Box.right - Size.cx) / 2;
+        else if (Label.Format & DT_RIGHT) Ink.left = Label.Box.right - Size.cx;
+        else Ink.left = Label.Box.left;
+        if (Label.Format & DT_VCENTER) Ink.top = (Label.Box.top + Label.Box.bottom - Size.cy) / 2;
+        else if (Label.Format & DT_BOTTOM) Ink.top = Label.Box.bottom - Size.cy;
+        else Ink.top = Label.Box.top;
+        Ink.right = Ink.left + Size.cx;
+        Ink.bottom = Ink.top + Size.cy;
+        Label.Ink = Ink;//空文本的宽度为0，剔除时视为不可见
+    }
+}
 
-        Cnt++;
+/// <summary>
+/// 剔除相互重叠的文本，使用均匀网格作为空间哈希，时间与文本个数成线性关系。
+/// 第一步：每个网格单元只保留中心落在其中的优先级最高的文本（网格单元不大于最小的文本，
+/// 因此同一单元中的两段文本必然重叠），剩余文本的个数只与屏幕面积有关；
+/// 第二步：按优先级从高到低放置剩余文本，与已放置的文本重叠则丢弃。这一步逐对检查矩形，
+/// 结果与网格尺寸无关，因此使用按平均文本尺寸划分的另一个网格，减少每段文本覆盖的单元数
+/// </summary>
+/// <param name="Labels">：已计算Ink的文本，结果写入Visible</param>
+/// <returns>保留的文本个数</returns>
+size_t CullChartLabels(vector<ChartLabel>& Labels) {
+    //第一步的网格单元取最小的文本尺寸（不能放大，否则同一单元中的文本不一定重叠），第二步取平均尺寸
+    int CellW = 0, CellH = 0;
+    long long SumW = 0, SumH = 0, Count = 0;
+    for (auto& Label : Labels) {
+        int W = Label.Ink.right - Label.Ink.left, H = Label.Ink.bottom - Label.Ink.top;
+        Label.Visible = Label.Always || (W > 0 && H > 0);
+        if (W <= 0 || H <= 0) continue;
+        CellW = CellW == 0 ? W : min(CellW, W);
+        CellH = CellH == 0 ? H : min(CellH, H);
+        SumW += W, SumH += H, Count++;
+    }
+    if (Count == 0) CellW = CellH = 1;
+    const int PlaceW = Count ? max((int)(SumW / Count), 4) : 4;
+    const int PlaceH = Count ? max((int)(SumH / Count), 4) : 4;
+    auto CellOf = [](LONG v, int Cell) { return v >= 0 ? v / Cell : (v - Cell + 1) / Cell; };
+    auto CellKey = [](long long cx, long long cy) { return (cx << 32) ^ (cy & 0xFFFFFFFFLL); };
+    auto Higher = [&Labels](size_t a, size_t b) {//a的优先级是否高于b
+        if (Labels[a].Always != Labels[b].Always) return Labels[a].Always;
+        if (Labels[a].Priority != Labels[b].Priority) return Labels[a].Priority > Labels[b].Priority;
+        return a < b;
+    };
+
+    //第一步：每个单元只保留一个候选
+    unordered_map<long long, size_t> Best;
+    Best.reserve(Labels.size());
+    vector<size_t> Candidates;
+    for (size_t i = 0; i < Labels.size(); i++) {
+        const ChartLabel& Label = Labels[i];
+        if (!Label.Visible) continue;
+        if (Label.Always) {
+            Candidates.emplace_back(i);
+            continue;
+        }
+        long long Key = CellKey(CellOf((Label.Ink.left + Label.Ink.right) / 2, CellW), CellOf((Label.Ink.top + Label.Ink.bottom) / 2, CellH));
+        auto it = Best.find(Key);
+        if (it == Best.end()) Best.emplace(Key, i);
+        else if (Higher(i, it->second)) {
+            Labels[it->second].Visible = false;
+            it->second = i;
+        }
+        else Labels[i].Visible = false;
+    }
+    for (auto& Cell : Best) Candidates.emplace_back(Cell.second);
+
+    //第二步：候选个数受网格单元数限制，排序代价与Bar的个数无关
+    sort(Candidates.begin(), Candidates.end(), Higher);
+    unordered_map<long long, vector<size_t>> Placed;
+    size_t Kept = 0;
+    for (size_t i : Candidates) {
+        ChartLabel& Label = Labels[i];
+        const RECT& Ink = Label.Ink;
+        long long x0 = CellOf(Ink.left, PlaceW), x1 = CellOf(Ink.right - 1, PlaceW), y0 = CellOf(Ink.top, PlaceH), y1 = CellOf(Ink.bottom - 1, PlaceH);
+        bool Hit = false;
+        if (!Label.Always && Ink.right > Ink.left) {
+            for (long long cx = x0; cx <= x1 && !Hit; cx++) {
+                for (long long cy = y0; cy <= y1 && !Hit; cy++) {
+                    auto it = Placed.find(CellKey(cx, cy));
+                    if (it == Placed.end()) continue;
+                    for (size_t j : it->second) {
+                        RECT Overlap;
+                        if (IntersectRect(&Overlap, &Ink, &Labels[j].Ink)) {
+                            Hit = true;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        if (Hit) {
+            Label.Visible = false;
+            continue;
+        }
+        if (Ink.right > Ink.left) {
+            for (long long cx = x0; cx <= x1; cx++)
+                for (long long cy = y0; cy <= y1; cy++)
+                    Placed[CellKey(cx, cy)].emplace_back(i);
+        }
+        Kept++;
+    }
+    return Kept;
+}
+
+//@brief 所有单位均使用对话框单位
+//@param hdc, StartPos, Data, Axis, Cache（为NULL时使用临时缓存，绘制结束后释放）
+//@param FitRect（不为NULL时将整个表格等比缩小后居中放入该区域，像素；文本与线条随之缩放）
+void DrawBarChart(HDC hdc, POINT StartPos, const ChartData& Data, COLORREF Axis = RGB(0, 0, 0), GdiCache* Cache = NULL,
+                  const RECT* FitRect = NULL) {
+    GdiCache LocalCache;
+    GdiCache& Res = Cache ? *Cache : LocalCache;//共享或临时的GDI资源
+
+    ChartLayout Layout = BuildChartLayout(Data, StartPos);
+
+    //通过世界坐标变换放入指定区域，布局与文本剔除仍在原坐标中进行
+    int OldMode = 0;
+    XFORM OldTransform;
+    if (FitRect) {
+        const RECT Bounds = ChartLayoutBounds(Layout);
+        const float BoundsW = (float)max(Bounds.right - Bounds.left, 1), BoundsH = (float)max(Bounds.bottom - Bounds.top, 1);
+        const float FitW = (float)(FitRect->right - FitRect->left), FitH = (float)(FitRect->bottom - FitRect->top);
+        float Scale = min(FitW / BoundsW, FitH / BoundsH);
+        Scale = max(min(Scale, 1.0f), 0.01f);//只缩小不放大
+        XFORM Fit;
+        Fit.eM11 = Scale, Fit.eM12 = 0, Fit.eM21 = 0, Fit.eM22 = Scale;
+        Fit.eDx = FitRect->left + (FitW - BoundsW * Scale) / 2 - Bounds.left * Scale;
+        Fit.eDy = FitRect->top + (FitH - BoundsH * Scale) / 2 - Bounds.top * Scale;
+        OldMode = SetGraphicsMode(hdc, GM_ADVANCED);
+        GetWorldTransform(hdc, &OldTransform);
+        SetWorldTransform(hdc, &Fit);
+    }
+
+    //选择指定颜色的画笔，并记录原有对象以便绘制结束后恢复
+    HGDIOBJ OldPen = SelectObject(hdc, Res.GetPen(PS_SOLID, 1, Axis));
+    HGDIOBJ OldBrush = NULL;
+    HGDIOBJ OldFont = NULL;
+
+    //绘制坐标轴
+    MoveToEx(hdc, Layout.Origin.x, Layout.Origin.y, NULL);
+    LineTo(hdc, Layout.XAxisEnd.x, Layout.XAxisEnd.y);//X
+    MoveToEx(hdc, Layout.Origin.x, Layout.Origin.y, NULL);
+    LineTo(hdc, Layout.YAxisEnd.x, Layout.YAxisEnd.y);//Y
+
+    //绘制Bar与图例色块
+    for (auto* Boxes : { &Layout.Bars, &Layout.SampleBoxes }) {
+        for (auto& Box : *Boxes) {
+            SelectObject(hdc, Res.GetPen(PS_INSIDEFRAME, 1, Box.Color));
+            HGDIOBJ PrevBrush = SelectObject(hdc, Res.GetHatchBrush(HS_BDIAGONAL, Box.Color));
+            if (!OldBrush) OldBrush = PrevBrush;
+            Rectangle(hdc, Box.Rect.left, Box.Rect.top, Box.Rect.right, Box.Rect.bottom);
+        }
+    }
+
+    //绘制文本
+    if (Data.GetAxisFont())//当字体已被设置时读取并应用字体
+        OldFont = SelectObject(hdc, Data.GetAxisFont());
+
+    UINT ExtraFormat = 0;
+    if (Data.IsLabelCullingEnable()) {//剔除重叠的文本
+        MeasureChartLabels(hdc, Data.GetAxisFont(), Layout.Labels, Res);
+        CullChartLabels(Layout.Labels);
+        ExtraFormat = DT_NOCLIP;//保留的文本互不重叠，完整绘制
+    }
+    for (auto& Label : Layout.Labels) {
+        if (!Label.Visible) continue;
+        RECT TextBox = Label.Box;
+        DrawText(hdc, Res.GetText(Label.Text).c_str(), -1, &TextBox, Label.Format | ExtraFormat);
+    }
+
+    //恢复原有对象，缓存中的对象由GdiCache统一释放
+    SelectObject(hdc, OldPen);
+    if (OldBrush) SelectObject(hdc, OldBrush);
+    if (OldFont) SelectObject(hdc, OldFont);
+    if (FitRect) {
+        SetWorldTransform(hdc, &OldTransform);//恢复为原变换后才能切换回原模式
+        SetGraphicsMode(hdc, OldMode);
+    }
+}
+
+/// <summary>
+/// 高精度计时器（QueryPerformanceCounter），用于帧时间预算与各项测试
+/// </summary>
+class Stopwatch {
+public:
+    Stopwatch() {
+        QueryPerformanceFrequency(&Freq);
+        Restart();
+    }
+
+    /// <summary>
+    /// 从现在开始重新计时
+    /// </summary>
+    void Restart() { QueryPerformanceCounter(&Begin); }
+
+    /// <summary>
+    /// 获取自构造或上次Restart以来经过的时间
+    /// </summary>
+    /// <returns>毫秒</returns>
+    double ElapsedMs() const {
+        LARGE_INTEGER Now;
+        QueryPerformanceCounter(&Now);
+        return (double)(Now.QuadPart - Begin.QuadPart) * 1000.0 / Freq.QuadPart;
+    }
+
+private:
+    LARGE_INTEGER Freq;
+    LARGE_INTEGER Begin;
+};
+
+/// <summary>
+/// 仪表盘：在同一个表面上排布多个表格，所有表格共享一份GdiCache。
+/// 每个表格等比缩放后绘制到自己区域大小的离屏位图中，仅在数据变化（版本号改变）且可见时重绘，
+/// 每帧的重绘时间不超过预算，超出预算的表格推迟到下一帧，未变化的表格直接贴图
+/// </summary>
+class Dashboard {
+public:
+    Dashboard() {}
+    Dashboard(const Dashboard&) = delete;
+    Dashboard& operator=(const Dashboard&) = delete;
+    ~Dashboard() { Clear(); }
+
+    /// <summary>
+    /// 添加一个表格
+    /// </summary>
+    /// <param name="Data">：表格数据，绘制时放入Layout或SetChartRect指定的区域</param>
+    /// <returns>表格的编号</returns>
+    size_t AddChart(const ChartData& Data) {
+        Tile NewTile;
+        NewTile.Data = Data;
+        Tiles.emplace_back(NewTile);
+        return Tiles.size() - 1;
+    }
+
+    /// <summary>
+    /// 获取表格数据以进行修改，修改后版本号变化，下一帧自动重绘
+    /// </summary>
+    /// <param name="i">：保证[0 &lt;= i &lt; size]</param>
+    /// <returns></returns>
+    ChartData& GetChart(size_t i) { return Tiles[i].Data; }
+
+    /// <summary>
+    /// 获取表格的个数
+    /// </summary>
+    /// <returns></returns>
+    size_t GetChartCount() const { return Tiles.size(); }
+
+    /// <summary>
+    /// 设置表格在表面上的区域（像素）
+    /// </summary>
+    /// <param name="i">：保证[0 &lt;= i &lt; size]</param>
+    /// <param name="Rect">：区域</param>
+    void SetChartRect(size_t i, RECT Rect) { Tiles[i].Rect = Rect; }
+
+    /// <summary>
+    /// 获取表格在表面上的区域（像素），修改表格后可用于InvalidateRect
+    /// </summary>
+    /// <param name="i">：保证[0 &lt;= i &lt; size]</param>
+    /// <returns></returns>
+    RECT GetChartRect(size_t i) const { return Tiles[i].Rect; }
+
+    /// <summary>
+    /// 强制重绘指定表格
+    /// </summary>
+    /// <param name="i">：保证[0 &lt;= i &lt; size]</param>
+    void Invalidate(size_t i) { Tiles[i].Rendered = false; }
+
+    /// <summary>
+    /// 按网格排布所有表格
+    /// </summary>
+    /// <param name="Client">：表面的区域（像素）</param>
+    /// <param name="Columns">：每行的表格数</param>
+    void Layout(RECT Client, int Columns) {
+        if (Tiles.empty() || Columns <= 0) return;
+        const int Rows = (int)((Tiles.size() + Columns - 1) / Columns);
+        const int CellW = (Client.right - Client.left) / Columns;
+        const int CellH = (Client.bottom - Client.top) / Rows;
+        for (size_t i = 0; i < Tiles.size(); i++) {
+            RECT Rect;
+            Rect.left = Client.left + (int)(i % Columns) * CellW;
+            Rect.top = Client.top + (int)(i / Columns) * CellH;
+            Rect.right = Rect.left + CellW;
+            Rect.bottom = Rect.top + CellH;
+            Tiles[i].Rect = Rect;
+        }
+    }
+
+    /// <summary>
+    /// 获取共享的GDI资源缓存，可用于为表格创建字体
+    /// </summary>
+    /// <returns></returns>
+    GdiCache& GetCache() { return Cache; }
+
+    /// <summary>
+    /// 绘制一帧：先在预算内重绘可见且已变化的表格，再将所有可见表格贴到hdc上
+    /// </summary>
+    /// <param name="hdc">：目标设备上下文</param>
+    /// <param name="Visible">：可见区域（像素），区域外的表格不重绘也不贴图</param>
+    /// <param name="BudgetMs">：本帧重绘的时间预算（毫秒），小于等于0表示不限制</param>
+    /// <returns>因超出预算而推迟的表格个数，大于0时应再次请求绘制</returns>
+    int RenderFrame(HDC hdc, RECT Visible, double BudgetMs) {
+        const Stopwatch Timer;
+
+        int Deferred = 0;
+        bool AnyRendered = false;
+        const size_t Count = Tiles.size();
+        for (size_t k = 0; k < Count; k++) {
+            size_t i = (NextTile + k) % Count;//从上一帧推迟的位置开始，保证每个表格最终都能被重绘
+            Tile& T = Tiles[i];
+            RECT Clip;
+            if (!IntersectRect(&Clip, &T.Rect, &Visible)) continue;//不可见
+            if (T.Rendered && T.RenderedVersion == T.Data.GetVersion()
+                && T.BmpW == T.Rect.right - T.Rect.left && T.BmpH == T.Rect.bottom - T.Rect.top) continue;//未变化
+
+            if (AnyRendered && BudgetMs > 0) {
+                if (Timer.ElapsedMs() >= BudgetMs) {
+                    if (Deferred == 0) NextTile = i;
+                    Deferred++;
+                    continue;
+                }
+            }
+            RenderTile(hdc, T);
+            AnyRendered = true;
+        }
+
+        for (auto& T : Tiles) {
+            RECT Clip;
+            if (!T.Rendered || !IntersectRect(&Clip, &T.Rect, &Visible)) continue;
+            BitBlt(hdc, Clip.left, Clip.top, Clip.right - Clip.left, Clip.bottom - Clip.top,
+                T.MemDC, Clip.left - T.Rect.left, Clip.top - T.Rect.top, SRCCOPY);
+        }
+        return Deferred;
+    }
+
+    /// <summary>
+    /// 移除所有表格并释放离屏位图与缓存
+    /// </summary>
+    void Clear() {
+        for (auto& T : Tiles) ReleaseTile(T);
+        Tiles.clear();
+        Cache.Clear();
+        NextTile = 0;
+    }
+
+private:
+    struct Tile {
+        ChartData Data;
+        RECT Rect = { 0,0,0,0 };//像素
+        HDC MemDC = NULL;//离屏设备上下文
+        HBITMAP Bitmap = NULL;
+        HGDIOBJ OldBitmap = NULL;
+        int BmpW = 0, BmpH = 0;
+        unsigned long long RenderedVersion = 0;//离屏位图对应的数据版本号
+        bool Rendered = false;
+    };
+
+    /// <summary>
+    /// 将表格绘制到离屏位图，位图尺寸随区域变化重建
+    /// </summary>
+    void RenderTile(HDC hdc, Tile& T) {
+        const int W = T.Rect.right - T.Rect.left, H = T.Rect.bottom - T.Rect.top;
+        if (!T.MemDC || T.BmpW != W || T.BmpH != H) {
+            ReleaseTile(T);
+            T.MemDC = CreateCompatibleDC(hdc);
+            T.Bitmap = CreateCompatibleBitmap(hdc, max(W, 1), max(H, 1));
+            T.OldBitmap = SelectObject(T.MemDC, T.Bitmap);
+            T.BmpW = W, T.BmpH = H;
+        }
+        PatBlt(T.MemDC, 0, 0, W, H, WHITENESS);
+        const RECT Fit = { TilePadding, TilePadding, W - TilePadding, H - TilePadding };//表格缩放后放入区域内
+        DrawBarChart(T.MemDC, POINT{ 0,0 }, T.Data, RGB(0, 0, 0), &Cache, &Fit);
+        T.RenderedVersion = T.Data.GetVersion();
+        T.Rendered = true;
+    }
+
+    void ReleaseTile(Tile& T) {
+        if (T.MemDC) {
+            SelectObject(T.MemDC, T.OldBitmap);
+            DeleteObject(T.Bitmap);
+            DeleteDC(T.MemDC);
+        }
+        T.MemDC = NULL, T.Bitmap = NULL, T.OldBitmap = NULL;
+        T.BmpW = T.BmpH = 0;
+        T.Rendered = false;
     }
+
+    static const int TilePadding = 4;//表格与区域边缘的距离（像素）
+    vector<Tile> Tiles;
+    GdiCache Cache;//所有表格共享
+    size_t NextTile = 0;//下一帧优先重绘的表格
+};
+
+struct DashboardTiming {
+    int Charts;//表格个数
+    double FullFrameMs;//所有表格都需要重绘时的帧时间
+    double CleanFrameMs;//所有表格都未变化时的帧时间
+    double UpdateFrameMs;//仅一个表格变化时的帧时间
+};
+
+/// <summary>
+/// 无窗口测量仪表盘的帧时间随表格数量的变化，绘制到内存位图上
+/// </summary>
+/// <param name="Sample">：每个格子使用的表格数据，缩放后放入格子</param>
+/// <param name="MaxCharts">：最大表格数</param>
+/// <param name="Step">：表格数的步长</param>
+/// <param name="Width">：表面宽度（像素）</param>
+/// <param name="Height">：表面高度（像素）</param>
+/// <returns>每种表格数下的帧时间</returns>
+vector<DashboardTiming> MeasureDashboardFrameTime(const ChartData& Sample, int MaxCharts, int Step = 5,
+                                                    int Width = 1920, int Height = 1080) {
+    vector<DashboardTiming> Result;
+    HDC RefDC = GetDC(NULL);//仅用于创建与屏幕格式相同的内存位图
+    HDC ScreenDC = CreateCompatibleDC(RefDC);
+    HBITMAP Surface = CreateCompatibleBitmap(RefDC, Width, Height);
+    ReleaseDC(NULL, RefDC);
+    HGDIOBJ OldSurface = SelectObject(ScreenDC, Surface);
+    const RECT Client = { 0,0,Width,Height };
+    Stopwatch Timer;
+
+    for (int n = max(Step, 1); n <= MaxCharts; n += max(Step, 1)) {
+        Dashboard TestBoard;
+        for (int i = 0; i < n; i++) TestBoard.AddChart(Sample);
+        int Columns = 1;
+        while (Columns * Columns < n) Columns++;
+        TestBoard.Layout(Client, Columns);
+
+        DashboardTiming Timing;
+        Timing.Charts = n;
+
+        Timer.Restart();
+        TestBoard.RenderFrame(ScreenDC, Client, 0);
+        Timing.FullFrameMs = Timer.ElapsedMs();
+
+        Timer.Restart();
+        TestBoard.RenderFrame(ScreenDC, Client, 0);
+        Timing.CleanFrameMs = Timer.ElapsedMs();
+
+        TestBoard.GetChart(0).SetXUnit(TestBoard.GetChart(0).GetXUnit());//使第一个表格变脏
+        Timer.Restart();
+        TestBoard.RenderFrame(ScreenDC, Client, 0);
+        Timing.UpdateFrameMs = Timer.ElapsedMs();
+
+        Result.emplace_back(Timing);
+    }
+
+    SelectObject(ScreenDC, OldSurface);
+    DeleteObject(Surface);
+    DeleteDC(ScreenDC);
+    return Result;
+}
+
+//不可变的表格快照，由写线程发布，读线程只读
+typedef shared_ptr<const ChartData> ChartSnapshot;
+
+/// <summary>
+/// 生成表格快照，Unit由快照与原表格共享，复制代价与Unit个数成正比而非Bar个数
+/// </summary>
+/// <param name="Data">：写线程正在修改的表格</param>
+/// <returns></returns>
+inline ChartSnapshot MakeSnapshot(const ChartData& Data) { return make_shared<const ChartData>(Data); }
+
+/// <summary>
+/// 渲染完成的一帧，32位像素，按行从上到下排列，每个像素在内存中依次为B、G、R、保留
+/// </summary>
+struct ChartFrame {
+    int Width = 0;
+    int Height = 0;
+    unsigned long long Version = 0;//对应的表格数据版本号
+    vector<DWORD> Pixels;
+};
+
+/// <summary>
+/// 离屏光栅化器：将表格绘制到DIB中并复制为ChartFrame，不依赖窗口，可在任意线程使用（同一实例只能由一个线程使用）
+/// </summary>
+class ChartRasterizer {
+public:
+    ChartRasterizer() {}
+    ChartRasterizer(const ChartRasterizer&) = delete;
+    ChartRasterizer& operator=(const ChartRasterizer&) = delete;
+    ~ChartRasterizer() { Release(); }
+
+    /// <summary>
+    /// 绘制表格
+    /// </summary>
+    /// <param name="Data">：表格数据</param>
+    /// <param name="StartPos">：表格起始点（对话框单位）</param>
+    /// <param name="Width">：帧宽度（像素）</param>
+    /// <param name="Height">：帧高度（像素）</param>
+    /// <returns>绘制失败时返回NULL</returns>
+    shared_ptr<ChartFrame> Render(const ChartData& Data, POINT StartPos, int Width, int Height) {
+        if (Width <= 0 || Height <= 0) return NULL;
+        if (!MemDC || Width != BmpW || Height != BmpH) {
+            Release();
+            BITMAPINFO Info;
+            memset(&Info, 0, sizeof(Info));
+            Info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+            Info.bmiHeader.biWidth = Width;
+            Info.bmiHeader.biHeight = -Height;//自上而下
+            Info.bmiHeader.biPlanes = 1;
+            Info.bmiHeader.biBitCount = 32;
+            Info.bmiHeader.biCompression = BI_RGB;
+            MemDC = CreateCompatibleDC(NULL);
+            Bitmap = CreateDIBSection(MemDC, &Info, DIB_RGB_COLORS, (void**)&Bits, NULL, 0);
+            if (!Bitmap) {
+                Release();
+                return NULL;
+            }
+            OldBitmap = SelectObject(MemDC, Bitmap);
+            BmpW = Width, BmpH = Height;
+        }
+
+        PatBlt(MemDC, 0, 0, Width, Height, WHITENESS);
+        DrawBarChart(MemDC, StartPos, Data, RGB(0, 0, 0), &Cache);
+        GdiFlush();//确保GDI已写完DIB
+
+        auto Frame = make_shared<ChartFrame>();
+        Frame->Width = Width;
+        Frame->Height = Height;
+        Frame->Version = Data.GetVersion();
+        Frame->Pixels.assign(Bits, Bits + (size_t)Width * Height);
+        return Frame;
+    }
+
+private:
+    void Release() {
+        if (MemDC) {
+            if (OldBitmap) SelectObject(MemDC, OldBitmap);
+            if (Bitmap) DeleteObject(Bitmap);
+            DeleteDC(MemDC);
+        }
+        MemDC = NULL, Bitmap = NULL, OldBitmap = NULL, Bits = NULL;
+        BmpW = BmpH = 0;
+    }
+
+    HDC MemDC = NULL;
+    HBITMAP Bitmap = NULL;
+    HGDIOBJ OldBitmap = NULL;
+    DWORD* Bits = NULL;//DIB像素，由Bitmap持有
+    int BmpW = 0, BmpH = 0;
+    GdiCache Cache;//仅供本光栅化器所在线程使用
+};
+
+/// <summary>
+/// 异步渲染线程：写线程发布快照后立即返回，渲染线程取最新的快照离屏绘制，再把完成的帧交给消费者。
+/// 渲染期间发布的多个快照只会渲染最后一个。消费者在渲染线程中被调用，UI可在其中保存帧并请求重绘，
+/// 无窗口时可替换为任意帧消费者
+/// </summary>
+class ChartRenderThread {
+public:
+    typedef function<void(shared_ptr<const ChartFrame>)> FrameConsumer;
+
+    /// <summary>
+    /// 创建并启动渲染线程
+    /// </summary>
+    /// <param name="Consumer">：帧消费者，在渲染线程中调用</param>
+    /// <param name="StartPos">：表格起始点（对话框单位）</param>
+    /// <param name="Width">：帧宽度（像素）</param>
+    /// <param name="Height">：帧高度（像素）</param>
+    ChartRenderThread(FrameConsumer Consumer, POINT StartPos, int Width, int Height)
+        : Consumer(Consumer), StartPos(StartPos), Width(Width), Height(Height) {
+        Worker = thread(&ChartRenderThread::Run, this);
+    }
+    ChartRenderThread(const ChartRenderThread&) = delete;
+    ChartRenderThread& operator=(const ChartRenderThread&) = delete;
+    ~ChartRenderThread() { Stop(); }
+
+    /// <summary>
+    /// 发布新的快照，不等待渲染
+    /// </summary>
+    /// <param name="Snapshot">：不可变的表格快照</param>
+    void Publish(ChartSnapshot Snapshot) {
+        atomic_store(&Latest, Snapshot);
+        Wake();
+    }
+
+    /// <summary>
+    /// 修改帧尺寸，并以最新的快照重新渲染
+    /// </summary>
+    void Resize(int NewWidth, int NewHeight) {
+        {
+            lock_guard<mutex> Lock(WakeLock);//宽高与Pending一起修改，渲染线程不会读到一半的尺寸
+            Width = NewWidth;
+            Height = NewHeight;
+            Pending = true;
+        }
+        WakeUp.notify_one();
+    }
+
+    /// <summary>
+    /// 获取最新发布的快照
+    /// </summary>
+    /// <returns></returns>
+    ChartSnapshot GetLatest() const { return atomic_load(&Latest); }
+
+    /// <summary>
+    /// 停止并等待渲染线程退出，之后不再调用消费者
+    /// </summary>
+    void Stop() {
+        {
+            lock_guard<mutex> Lock(WakeLock);
+            Stopping = true;
+        }
+        WakeUp.notify_one();
+        if (Worker.joinable()) Worker.join();
+    }
+
+private:
+    void Wake() {
+        {
+            lock_guard<mutex> Lock(WakeLock);//只保护标志位，渲染期间不持有
+            Pending = true;
+        }
+        WakeUp.notify_one();
+    }
+
+    void Run() {
+        ChartRasterizer Rasterizer;
+        for (;;) {
+            int FrameW, FrameH;
+            {
+                unique_lock<mutex> Lock(WakeLock);
+                WakeUp.wait(Lock, [this] { return Pending || Stopping; });
+                if (Stopping) break;
+                Pending = false;
+                FrameW = Width;//在锁内一并复制
+                FrameH = Height;
+            }
+            ChartSnapshot Snapshot = atomic_load(&Latest);
+            if (!Snapshot) continue;
+            shared_ptr<const ChartFrame> Frame = Rasterizer.Render(*Snapshot, StartPos, FrameW, FrameH);
+            if (Frame) Consumer(Frame);
+        }
+    }
+
+    FrameConsumer Consumer;
+    POINT StartPos;
+    ChartSnapshot Latest;//只通过atomic_load/atomic_store访问
+    mutex WakeLock;
+    condition_variable WakeUp;
+    int Width, Height;//由WakeLock保护
+    bool Pending = false;//有新的快照或尺寸变化
+    bool Stopping = false;
+    thread Worker;//在构造函数体中启动，此时其他成员均已就绪
+};
+
+/// <summary>
+/// 将帧绘制到设备上下文
+/// </summary>
+/// <param name="hdc">：目标设备上下文</param>
+/// <param name="Frame">：完成的帧，可以为NULL</param>
+void PresentChartFrame(HDC hdc, const ChartFrame* Frame) {
+    if (!Frame || Frame->Pixels.empty()) return;
+    BITMAPINFO Info;
+    memset(&Info, 0, sizeof(Info));
+    Info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    Info.bmiHeader.biWidth = Frame->Width;
+    Info.bmiHeader.biHeight = -Frame->Height;
+    Info.bmiHeader.biPlanes = 1;
+    Info.bmiHeader.biBitCount = 32;
+    Info.bmiHeader.biCompression = BI_RGB;
+    SetDIBitsToDevice(hdc, 0, 0, Frame->Width, Frame->Height, 0, 0, 0, Frame->Height,
+        Frame->Pixels.data(), &Info, DIB_RGB_COLORS);
+}
+
+//编码结果的输出，按文件顺序多次调用，可直接写入文件或网络
+typedef function<void(const unsigned char*, size_t)> ImageSink;
+
+enum class ImageFormat {
+    QOI,//编码最快
+    PNG//兼容性最好，按行条带多线程压缩
+};
+
+//帧中像素的R、G、B分量
+inline unsigned char PixelR(DWORD Pixel) { return (unsigned char)(Pixel >> 16); }
+inline unsigned char PixelG(DWORD Pixel) { return (unsigned char)(Pixel >> 8); }
+inline unsigned char PixelB(DWORD Pixel) { return (unsigned char)Pixel; }
+
+//按大端序写入32位整数
+inline void PutBigEndian32(unsigned char* Out, unsigned int Value) {
+    Out[0] = (unsigned char)(Value >> 24);
+    Out[1] = (unsigned char)(Value >> 16);
+    Out[2] = (unsigned char)(Value >> 8);
+    Out[3] = (unsigned char)Value;
+}
+
+/// <summary>
+/// 以QOI格式编码帧（3通道，sRGB），每编码若干行输出一次
+/// </summary>
+/// <param name="Frame">：完成的帧</param>
+/// <param name="Sink">：输出</param>
+/// <returns>帧为空时返回false</returns>
+bool EncodeQOI(const ChartFrame& Frame, const ImageSink& Sink) {
+    if (Frame.Width <= 0 || Frame.Height <= 0 || Frame.Pixels.size() < (size_t)Frame.Width * Frame.Height) return false;
+    const size_t FlushSize = 64 * 1024;//缓冲区超过该大小时在行尾输出
+
+    vector<unsigned char> Out;
+    Out.reserve(FlushSize + (size_t)Frame.Width * 4 + 16);
+    unsigned char Header[14] = { 'q','o','i','f' };
+    PutBigEndian32(Header + 4, Frame.Width);
+    PutBigEndian32(Header + 8, Frame.Height);
+    Header[12] = 3;//通道数
+    Header[13] = 0;//sRGB
+    Out.insert(Out.end(), Header, Header + 14);
+
+    DWORD Index[64];//最近出现过的颜色
+    for (auto& Entry : Index) Entry = 0xFF000000;//不会与帧中的像素（高8位为0）相等
+    DWORD Prev = 0;//alpha为255的黑色
+    int Run = 0;
+    const size_t Total = (size_t)Frame.Width * Frame.Height;
+    for (size_t i = 0; i < Total; i++) {
+        const DWORD Pixel = Frame.Pixels[i] & 0xFFFFFF;//忽略保留字节
+        if (Pixel == Prev) {
+            Run++;
+            if (Run == 62 || i + 1 == Total) {
+                Out.push_back((unsigned char)(0xC0 | (Run - 1)));//QOI_OP_RUN
+                Run = 0;
+            }
+        }
+        else {
+            if (Run > 0) {
+                Out.push_back((unsigned char)(0xC0 | (Run - 1)));
+                Run = 0;
+            }
+            const unsigned char R = PixelR(Pixel), G = PixelG(Pixel), B = PixelB(Pixel);
+            const int Hash = (R * 3 + G * 5 + B * 7 + 255 * 11) % 64;
+            if (Index[Hash] == Pixel) Out.push_back((unsigned char)Hash);//QOI_OP_INDEX
+            else {
+                Index[Hash] = Pixel;
+                const signed char dR = (signed char)(R - PixelR(Prev));
+                const signed char dG = (signed char)(G - PixelG(Prev));
+                const signed char dB = (signed char)(B - PixelB(Prev));
+                const signed char dRG = (signed char)(dR - dG), dBG = (signed char)(dB - dG);
+                if (dR > -3 && dR < 2 && dG > -3 && dG < 2 && dB > -3 && dB < 2)//QOI_OP_DIFF
+                    Out.push_back((unsigned char)(0x40 | (dR + 2) << 4 | (dG + 2) << 2 | (dB + 2)));
+                else if (dRG > -9 && dRG < 8 && dG > -33 && dG < 32 && dBG > -9 && dBG < 8) {//QOI_OP_LUMA
+                    Out.push_back((unsigned char)(0x80 | (dG + 32)));
+                    Out.push_back((unsigned char)((dRG + 8) << 4 | (dBG + 8)));
+                }
+                else {//QOI_OP_RGB
+                    Out.push_back(0xFE);
+                    Out.push_back(R);
+                    Out.push_back(G);
+                    Out.push_back(B);
+                }
+            }
+            Prev = Pixel;
+        }
+        if ((i + 1) % Frame.Width == 0 && Out.size() >= FlushSize) {//行尾输出
+            Sink(Out.data(), Out.size());
+            Out.clear();
+        }
+    }
+
+    static const unsigned char End[8] = { 0,0,0,0,0,0,0,1 };
+    Out.insert(Out.end(), End, End + 8);
+    Sink(Out.data(), Out.size());
+    return true;
+}
+
+//CRC32（PNG数据块校验）
+unsigned int Crc32Update(unsigned int Crc, const unsigned char* Data, size_t Len) {
+    static const struct CrcTable {
+        unsigned int Value[256];
+        CrcTable() {
+            for (unsigned int n = 0; n < 256; n++) {
+                unsigned int c = n;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                Value[n] = c;
+            }
+        }
+    } Table;
+    Crc = ~Crc;
+    for (size_t i = 0; i < Len; i++) Crc = Table.Value[(Crc ^ Data[i]) & 0xFF] ^ (Crc >> 8);
+    return ~Crc;
+}
+
+//Adler-32（zlib数据校验），初始值为1
+unsigned int Adler32Update(unsigned int Adler, const unsigned char* Data, size_t Len) {
+    const unsigned int Base = 65521;
+    unsigned int a = Adler & 0xFFFF, b = Adler >> 16;
+    while (Len > 0) {
+        size_t Block = min(Len, (size_t)5552);//保证b不溢出
+        Len -= Block;
+        while (Block--) {
+            a += *Data++;
+            b += a;
+        }
+        a %= Base;
+        b %= Base;
+    }
+    return a | (b << 16);
+}
+
+//合并两段数据的Adler-32，Len2为第二段的长度，使各条带可以独立计算
+unsigned int Adler32Combine(unsigned int Adler1, unsigned int Adler2, size_t Len2) {
+    const unsigned int Base = 65521;
+    const unsigned int Rem = (unsigned int)(Len2 % Base);
+    unsigned int Sum1 = Adler1 & 0xFFFF;
+    unsigned int Sum2 = (unsigned int)(((unsigned long long)Rem * Sum1) % Base);
+    Sum1 += (Adler2 & 0xFFFF) + Base - 1;
+    Sum2 += (Adler1 >> 16) + (Adler2 >> 16) + Base - Rem;
+    if (Sum1 >= Base) Sum1 -= Base;
+    if (Sum1 >= Base) Sum1 -= Base;
+    if (Sum2 >= (Base << 1)) Sum2 -= (Base << 1);
+    if (Sum2 >= Base) Sum2 -= Base;
+    return Sum1 | (Sum2 << 16);
+}
+
+/// <summary>
+/// 使用固定Huffman编码的deflate压缩器。图表在行过滤后大部分是连续的0，
+/// 距离为1的重复串即可覆盖，因此只用单项哈希表查找其他重复串，不建立哈希链
+/// </summary>
+class FixedDeflater {
+public:
+    /// <summary>
+    /// 将Data压缩为一个deflate块追加到Out。非最后一块以空的存储块结尾并按字节对齐，
+    /// 各条带的输出可以直接拼接为一个完整的deflate流
+    /// </summary>
+    /// <param name="Data">：数据</param>
+    /// <param name="Len">：数据长度</param>
+    /// <param name="Final">：是否为整个流的最后一块</param>
+    /// <param name="Out">：输出</param>
+    static void Compress(const unsigned char* Data, size_t Len, bool Final, vector<unsigned char>& Out) {
+        const Tables& T = GetTables();
+        BitWriter Bits(Out);
+        Bits.Put(Final ? 1 : 0, 1);//BFINAL
+        Bits.Put(1, 2);//BTYPE = 01，固定Huffman
+
+        vector<int> Head(1 << HashBits, -1);//哈希 -> 最近的位置
+        size_t i = 0;
+        while (i < Len) {
+            size_t BestLen = 0, BestDist = 0;
+            if (i + 3 <= Len) {
+                const size_t MaxLen = min(Len - i, (size_t)258);
+                if (i >= 1) {//距离为1的重复（过滤后的纯色区域）
+                    size_t l = 0;
+                    while (l < MaxLen && Data[i + l] == Data[i + l - 1]) l++;
+                    if (l >= 3) BestLen = l, BestDist = 1;
+                }
+                if (BestLen < MaxLen) {
+                    const unsigned int h = Hash(Data + i);
+                    const int Cand = Head[h];
+                    Head[h] = (int)i;
+                    if (Cand >= 0 && i - Cand <= 32768 && i - Cand > 1) {
+                        size_t l = 0;
+                        while (l < MaxLen && Data[i + l] == Data[Cand + l]) l++;
+                        if (l > BestLen) BestLen = l, BestDist = i - Cand;
+                    }
+                }
+            }
+
+            if (BestLen >= 3) {
+                const int Sym = T.LenSym[BestLen];
+                Bits.Put(T.LitCode[Sym], T.LitLen[Sym]);
+                Bits.Put((unsigned int)(BestLen - LenBase[Sym - 257]), LenExtra[Sym - 257]);
+                const int DSym = T.DistSym[BestDist];
+                Bits.Put(T.DistCode[DSym], 5);
+                Bits.Put((unsigned int)(BestDist - DistBase[DSym]), DistExtra[DSym]);
+                if (BestLen < 16) {//较短的重复串也记录其中的位置，长串跳过以保证速度
+                    for (size_t k = 1; k < BestLen && i + k + 3 <= Len; k++)
+                        Head[Hash(Data + i + k)] = (int)(i + k);
+                }
+                i += BestLen;
+            }
+            else {
+                Bits.Put(T.LitCode[Data[i]], T.LitLen[Data[i]]);
+                i++;
+            }
+        }
+        Bits.Put(T.LitCode[256], T.LitLen[256]);//块结束
+
+        if (!Final) {
+            Bits.Put(0, 3);//空的存储块（BFINAL = 0, BTYPE = 00）
+            Bits.Align();
+            static const unsigned char Empty[4] = { 0x00, 0x00, 0xFF, 0xFF };
+            Out.insert(Out.end(), Empty, Empty + 4);
+        }
+        else Bits.Align();
+    }
+
+    /// <summary>
+    /// 解压缩deflate流，只支持存储块与固定Huffman块（即Compress的输出），用于校验编码结果
+    /// </summary>
+    /// <param name="Data">：deflate流</param>
+    /// <param name="Len">：长度</param>
+    /// <param name="Out">：解压缩的数据追加到其尾部</param>
+    /// <returns>流损坏或包含动态Huffman块时返回false</returns>
+    static bool Decompress(const unsigned char* Data, size_t Len, vector<unsigned char>& Out) {
+        size_t Pos = 0;//位位置
+        bool Overrun = false;
+        auto Bits = [&](int Count) {//按位从低到高读取
+            unsigned int Value = 0;
+            for (int k = 0; k < Count; k++, Pos++) {
+                if ((Pos >> 3) >= Len) {
+                    Overrun = true;
+                    return 0u;
+                }
+                Value |= (unsigned int)((Data[Pos >> 3] >> (Pos & 7)) & 1) << k;
+            }
+            return Value;
+        };
+        auto HuffBits = [&](int Count) {//Huffman编码从高位开始
+            unsigned int Value = 0;
+            for (int k = 0; k < Count; k++) Value = (Value << 1) | Bits(1);
+            return Value;
+        };
+
+        bool Final = false;
+        const size_t Start = Out.size();
+        while (!Final) {
+            Final = Bits(1) == 1;
+            const unsigned int Type = Bits(2);
+            if (Type == 0) {//存储块
+                Pos = (Pos + 7) & ~(size_t)7;
+                const unsigned int StoredLen = Bits(16), NLen = Bits(16);
+                if (Overrun || (StoredLen ^ 0xFFFF) != NLen || (Pos >> 3) + StoredLen > Len) return false;
+                Out.insert(Out.end(), Data + (Pos >> 3), Data + (Pos >> 3) + StoredLen);
+                Pos += (size_t)StoredLen * 8;
+                continue;
+            }
+            if (Type != 1) return false;
+
+            for (;;) {
+                int Sym;//固定Huffman：7位256~279，8位0~143与280~287，9位144~255
+                unsigned int Code = HuffBits(7);
+                if (Code <= 0x17) Sym = 256 + Code;
+                else {
+                    Code = (Code << 1) | Bits(1);
+                    if (Code >= 0x30 && Code <= 0xBF) Sym = Code - 0x30;
+                    else if (Code >= 0xC0 && Code <= 0xC7) Sym = 280 + Code - 0xC0;
+                    else Sym = 144 + ((Code << 1) | Bits(1)) - 0x190;
+                }
+                if (Overrun || Sym > 285) return false;
+                if (Sym < 256) Out.push_back((unsigned char)Sym);
+                else if (Sym == 256) break;
+                else {
+                    const size_t Length = LenBase[Sym - 257] + Bits(LenExtra[Sym - 257]);
+                    const unsigned int DSym = HuffBits(5);
+                    if (DSym >= 30) return false;
+                    const size_t Dist = DistBase[DSym] + Bits(DistExtra[DSym]);
+                    if (Overrun || Dist > Out.size() - Start) return false;
+                    for (size_t k = 0; k < Length; k++) Out.push_back(Out[Out.size() - Dist]);
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    static const int HashBits = 15;
+
+    static unsigned int Hash(const unsigned char* p) {
+        return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1 << HashBits) - 1);
+    }
+
+    //按位从低到高写入
+    class BitWriter {
+    public:
+        explicit BitWriter(vector<unsigned char>& Out) : Out(Out) {}
+        void Put(unsigned int Value, int Count) {
+            Buffer |= (unsigned long long)Value << Used;
+            Used += Count;
+            while (Used >= 8) {
+                Out.push_back((unsigned char)Buffer);
+                Buffer >>= 8;
+                Used -= 8;
+            }
+        }
+        void Align() {
+            if (Used > 0) Out.push_back((unsigned char)Buffer);
+            Buffer = 0, Used = 0;
+        }
+    private:
+        vector<unsigned char>& Out;
+        unsigned long long Buffer = 0;
+        int Used = 0;
+    };
+
+    static const unsigned short LenBase[29];
+    static const unsigned char LenExtra[29];
+    static const unsigned short DistBase[30];
+    static const unsigned char DistExtra[30];
+
+    struct Tables {
+        unsigned short LitCode[288];//已按位反转，可直接从低位写入
+        unsigned char LitLen[288];
+        unsigned char DistCode[30];
+        unsigned short LenSym[259];//长度 -> 符号
+        unsigned char DistSym[32769];//距离 -> 符号
+
+        static unsigned int Reverse(unsigned int Code, int Len) {
+            unsigned int r = 0;
+            for (int k = 0; k < Len; k++) r = (r << 1) | ((Code >> k) & 1);
+            return r;
+        }
+
+        Tables() {
+            for (int v = 0; v < 288; v++) {
+                unsigned int Code;
+                int Len;
+                if (v < 144) Code = 0x30 + v, Len = 8;
+                else if (v < 256) Code = 0x190 + v - 144, Len = 9;
+                else if (v < 280) Code = v - 256, Len = 7;
+                else Code = 0xC0 + v - 280, Len = 8;
+                LitCode[v] = (unsigned short)Reverse(Code, Len);
+                LitLen[v] = (unsigned char)Len;
+            }
+            for (int d = 0; d < 30; d++) DistCode[d] = (unsigned char)Reverse(d, 5);
+            for (int s = 0; s < 29; s++)
+                for (int l = LenBase[s]; l < LenBase[s] + (1 << LenExtra[s]) && l <= 258; l++)
+                    LenSym[l] = (unsigned short)(257 + s);
+            LenSym[258] = 285;//258有单独的符号
+            for (int s = 0; s < 30; s++)
+                for (int d = DistBase[s]; d < DistBase[s] + (1 << DistExtra[s]) && d <= 32768; d++)
+                    DistSym[d] = (unsigned char)s;
+        }
+    };
+
+    static const Tables& GetTables() {
+        static const Tables T;//首次使用时初始化，线程安全
+        return T;
+    }
+};
+
+const unsigned short FixedDeflater::LenBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+const unsigned char FixedDeflater::LenExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+const unsigned short FixedDeflater::DistBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+const unsigned char FixedDeflater::DistExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+/// <summary>
+/// 对一行RGB数据选择过滤方式并写入Out（过滤类型 + 过滤后的数据）。
+/// 与上一行相同的行直接使用Up（全为0），否则在None、Sub、Up中选择绝对值之和最小者，
+/// 纯色区域在Sub下、重复的行在Up下都会变成连续的0
+/// </summary>
+void FilterPngRow(const unsigned char* Row, const unsigned char* PrevRow, size_t RowBytes, unsigned char* Out) {
+    const int Bpp = 3;
+    int Type = 0;
+    if (PrevRow && memcmp(Row, PrevRow, RowBytes) == 0) Type = 2;
+    else {
+        unsigned long long Cost[3] = { 0,0,0 };
+        for (size_t x = 0; x < RowBytes; x++) {
+            unsigned char None = Row[x];
+            unsigned char Sub = (unsigned char)(Row[x] - (x >= Bpp ? Row[x - Bpp] : 0));
+            unsigned char Up = (unsigned char)(Row[x] - (PrevRow ? PrevRow[x] : 0));
+            Cost[0] += None < 128 ? None : 256 - None;
+            Cost[1] += Sub < 128 ? Sub : 256 - Sub;
+            Cost[2] += Up < 128 ? Up : 256 - Up;
+        }
+        if (Cost[1] < Cost[Type]) Type = 1;
+        if (Cost[2] < Cost[Type]) Type = 2;
+    }
+
+    Out[0] = (unsigned char)Type;
+    for (size_t x = 0; x < RowBytes; x++) {
+        if (Type == 0) Out[1 + x] = Row[x];
+        else if (Type == 1) Out[1 + x] = (unsigned char)(Row[x] - (x >= Bpp ? Row[x - Bpp] : 0));
+        else Out[1 + x] = (unsigned char)(Row[x] - (PrevRow ? PrevRow[x] : 0));
+    }
+}
+
+/// <summary>
+/// 以PNG格式编码帧（8位RGB）。图像按行分为若干条带，由多个线程分别过滤并压缩，
+/// 每个条带完成后按顺序作为一个IDAT块输出，单线程时每压缩一个条带即输出一个
+/// </summary>
+/// <param name="Frame">：完成的帧</param>
+/// <param name="Sink">：输出，只在调用线程中调用</param>
+/// <param name="Threads">：线程数，小于等于0时使用CPU核心数</param>
+/// <param name="StripeRows">：每个条带的行数</param>
+/// <returns>帧为空时返回false</returns>
+bool EncodePNG(const ChartFrame& Frame, const ImageSink& Sink, int Threads = 0, int StripeRows = 64) {
+    if (Frame.Width <= 0 || Frame.Height <= 0 || Frame.Pixels.size() < (size_t)Frame.Width * Frame.Height) return false;
+    StripeRows = max(StripeRows, 1);
+    if (Threads <= 0) Threads = max((int)thread::hardware_concurrency(), 1);
+
+    const int Width = Frame.Width, Height = Frame.Height;
+    const size_t RowBytes = (size_t)Width * 3;
+    const int StripeCount = (Height + StripeRows - 1) / StripeRows;
+    Threads = min(Threads, StripeCount);
+
+    struct Stripe {
+        vector<unsigned char> Data;//压缩后的数据
+        unsigned int Adler = 1;//过滤后数据的Adler-32
+        size_t RawLen = 0;//过滤后数据的长度
+        bool Done = false;
+    };
+    vector<Stripe> Stripes(StripeCount);
+    atomic<int> NextStripe(0);
+    mutex DoneLock;
+    condition_variable DoneSignal;
+
+    //过滤并压缩一个条带，Row、PrevRow、Filtered为各线程自己的缓冲区
+    auto CompressStripe = [&](int s, vector<unsigned char>& Row, vector<unsigned char>& PrevRow, vector<unsigned char>& Filtered) {
+        const int y0 = s * StripeRows, y1 = min(y0 + StripeRows, Height);
+        Row.resize(RowBytes);
+        PrevRow.resize(RowBytes);
+        Filtered.resize((size_t)(y1 - y0) * (RowBytes + 1));
+
+        auto ToRGB = [&Frame, Width](int y, unsigned char* Out) {
+            const DWORD* Src = &Frame.Pixels[(size_t)y * Width];
+            for (int x = 0; x < Width; x++) {
+                Out[x * 3] = PixelR(Src[x]);
+                Out[x * 3 + 1] = PixelG(Src[x]);
+                Out[x * 3 + 2] = PixelB(Src[x]);
+            }
+        };
+        if (y0 > 0) ToRGB(y0 - 1, PrevRow.data());//Up过滤需要上一条带的最后一行
+        for (int y = y0; y < y1; y++) {
+            ToRGB(y, Row.data());
+            FilterPngRow(Row.data(), y > 0 ? PrevRow.data() : NULL, RowBytes, &Filtered[(size_t)(y - y0) * (RowBytes + 1)]);
+            Row.swap(PrevRow);
+        }
+
+        Stripe& Result = Stripes[s];
+        Result.RawLen = Filtered.size();
+        Result.Adler = Adler32Update(1, Filtered.data(), Filtered.size());
+        FixedDeflater::Compress(Filtered.data(), Filtered.size(), s == StripeCount - 1, Result.Data);
+    };
+
+    auto Work = [&]() {
+        vector<unsigned char> Row, PrevRow, Filtered;
+        for (;;) {
+            const int s = NextStripe++;
+            if (s >= StripeCount) break;
+            CompressStripe(s, Row, PrevRow, Filtered);
+            {
+                lock_guard<mutex> Lock(DoneLock);
+                Stripes[s].Done = true;
+            }
+            DoneSignal.notify_all();
+        }
+    };
+
+    //多线程时调用线程只负责按顺序输出；单线程时在输出循环中逐个压缩，每个条带完成后立即输出
+    vector<thread> Workers;
+    struct JoinGuard {//Sink抛出异常时也要等待工作线程结束，否则析构可连接的thread会终止进程
+        vector<thread>& Workers;
+        ~JoinGuard() {
+            for (auto& Worker : Workers)
+                if (Worker.joinable()) Worker.join();
+        }
+    } Guard = { Workers };
+    if (Threads > 1) {
+        for (int t = 0; t < Threads; t++) Workers.emplace_back(Work);
+    }
+    vector<unsigned char> Row, PrevRow, Filtered;
+
+    auto WriteChunk = [&Sink](const char* Type, const unsigned char* Prefix, size_t PrefixLen,
+                              const unsigned char* Data, size_t Len, const unsigned char* Suffix, size_t SuffixLen) {
+        unsigned char Head[8];
+        PutBigEndian32(Head, (unsigned int)(PrefixLen + Len + SuffixLen));
+        memcpy(Head + 4, Type, 4);
+        unsigned int Crc = Crc32Update(0, Head + 4, 4);
+        Crc = Crc32Update(Crc, Prefix, PrefixLen);
+        Crc = Crc32Update(Crc, Data, Len);
+        Crc = Crc32Update(Crc, Suffix, SuffixLen);
+        unsigned char Tail[4];
+        PutBigEndian32(Tail, Crc);
+        Sink(Head, 8);
+        if (PrefixLen) Sink(Prefix, PrefixLen);
+        if (Len) Sink(Data, Len);
+        if (SuffixLen) Sink(Suffix, SuffixLen);
+        Sink(Tail, 4);
+    };
+
+    static const unsigned char Signature[8] = { 0x89,'P','N','G','\r','\n',0x1A,'\n' };
+    Sink(Signature, 8);
+    unsigned char IHDR[13];
+    PutBigEndian32(IHDR, Width);
+    PutBigEndian32(IHDR + 4, Height);
+    IHDR[8] = 8;//位深
+    IHDR[9] = 2;//RGB
+    IHDR[10] = IHDR[11] = IHDR[12] = 0;//压缩、过滤、隔行
+    WriteChunk("IHDR", NULL, 0, IHDR, 13, NULL, 0);
+
+    //按顺序输出已完成的条带
+    static const unsigned char ZlibHeader[2] = { 0x78, 0x01 };
+    unsigned int Adler = 1;
+    for (int s = 0; s < StripeCount; s++) {
+        if (Threads <= 1) CompressStripe(s, Row, PrevRow, Filtered);
+        else {
+            unique_lock<mutex> Lock(DoneLock);
+            DoneSignal.wait(Lock, [&Stripes, s] { return Stripes[s].Done; });
+        }
+        Stripe& Current = Stripes[s];
+        Adler = s == 0 ? Current.Adler : Adler32Combine(Adler, Current.Adler, Current.RawLen);
+        unsigned char Trailer[4];
+        PutBigEndian32(Trailer, Adler);
+        const bool Last = s == StripeCount - 1;
+        WriteChunk("IDAT", s == 0 ? ZlibHeader : NULL, s == 0 ? 2 : 0, Current.Data.data(), Current.Data.size(),
+            Last ? Trailer : NULL, Last ? 4 : 0);
+        vector<unsigned char>().swap(Current.Data);//已输出的条带立即释放
+    }
+    WriteChunk("IEND", NULL, 0, NULL, 0, NULL, 0);
+    return true;//工作线程由Guard等待
+}
+
+/// <summary>
+/// 将帧编码并写入文件
+/// </summary>
+/// <param name="Frame">：完成的帧</param>
+/// <param name="Path">：文件路径</param>
+/// <param name="Format">：图像格式</param>
+/// <returns>bool类型: [true]成功, [false]失败</returns>
+bool SaveChartFrame(const ChartFrame& Frame, LPCWSTR Path, ImageFormat Format = ImageFormat::PNG) {
+    HANDLE hFile = CreateFile(Path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+    bool Ok = true;
+    ImageSink Sink = [hFile, &Ok](const unsigned char* Data, size_t Len) {
+        DWORD Written = 0;
+        if (Ok && (!WriteFile(hFile, Data, (DWORD)Len, &Written, NULL) || Written != Len)) Ok = false;
+    };
+    bool Encoded = Format == ImageFormat::QOI ? EncodeQOI(Frame, Sink) : EncodePNG(Frame, Sink);
+    CloseHandle(hFile);
+    return Encoded && Ok;
+}
+
+/// <summary>
+/// 不经过窗口，直接将表格绘制并导出为图像文件
+/// </summary>
+/// <param name="Data">：表格数据</param>
+/// <param name="StartPos">：表格起始点（对话框单位）</param>
+/// <param name="Width">：图像宽度（像素）</param>
+/// <param name="Height">：图像高度（像素）</param>
+/// <param name="Path">：文件路径</param>
+/// <param name="Format">：图像格式</param>
+/// <returns>bool类型: [true]成功, [false]失败</returns>
+bool ExportChart(const ChartData& Data, POINT StartPos, int Width, int Height, LPCWSTR Path, ImageFormat Format = ImageFormat::PNG) {
+    ChartRasterizer Rasterizer;
+    shared_ptr<ChartFrame> Frame = Rasterizer.Render(Data, StartPos, Width, Height);
+    if (!Frame) return false;
+    return SaveChartFrame(*Frame, Path, Format);
+}
+
+//按大端序读取32位整数
+inline unsigned int GetBigEndian32(const unsigned char* In) {
+    return (unsigned int)In[0] << 24 | (unsigned int)In[1] << 16 | (unsigned int)In[2] << 8 | In[3];
+}
+
+/// <summary>
+/// 解码QOI图像（3或4通道，忽略alpha），用于校验EncodeQOI的输出
+/// </summary>
+/// <param name="Data">：QOI文件内容</param>
+/// <param name="Frame">：解码结果，像素格式与ChartFrame相同</param>
+/// <returns>文件损坏时返回false</returns>
+bool DecodeQOI(const vector<unsigned char>& Data, ChartFrame& Frame) {
+    if (Data.size() < 22 || memcmp(Data.data(), "qoif", 4) != 0) return false;
+    Frame.Width = (int)GetBigEndian32(&Data[4]);
+    Frame.Height = (int)GetBigEndian32(&Data[8]);
+    const size_t Total = (size_t)Frame.Width * Frame.Height;
+    if (Frame.Width <= 0 || Frame.Height <= 0 || Total > Data.size() * 62) return false;
+    Frame.Pixels.assign(Total, 0);
+
+    unsigned char Index[64][4];
+    memset(Index, 0, sizeof(Index));
+    unsigned char R = 0, G = 0, B = 0, A = 255;
+    size_t p = 14;
+    const size_t End = Data.size() - 8;
+    for (size_t i = 0; i < Total; i++) {
+        if (p >= End) return false;
+        const unsigned char Op = Data[p++];
+        int Run = 1;
+        if (Op == 0xFE || Op == 0xFF) {//QOI_OP_RGB、QOI_OP_RGBA
+            if (p + (Op == 0xFF ? 4 : 3) > End) return false;
+            R = Data[p++], G = Data[p++], B = Data[p++];
+            if (Op == 0xFF) A = Data[p++];
+        }
+        else if ((Op & 0xC0) == 0x00) {//QOI_OP_INDEX
+            R = Index[Op][0], G = Index[Op][1], B = Index[Op][2], A = Index[Op][3];
+        }
+        else if ((Op & 0xC0) == 0x40) {//QOI_OP_DIFF
+            R += ((Op >> 4) & 3) - 2, G += ((Op >> 2) & 3) - 2, B += (Op & 3) - 2;
+        }
+        else if ((Op & 0xC0) == 0x80) {//QOI_OP_LUMA
+            if (p >= End) return false;
+            const int dG = (Op & 0x3F) - 32, Next = Data[p++];
+            R += dG - 8 + (Next >> 4), G += dG, B += dG - 8 + (Next & 0x0F);
+        }
+        else Run = (Op & 0x3F) + 1;//QOI_OP_RUN
+        const int Hash = (R * 3 + G * 5 + B * 7 + A * 11) % 64;
+        Index[Hash][0] = R, Index[Hash][1] = G, Index[Hash][2] = B, Index[Hash][3] = A;
+        for (int k = 0; k < Run && i < Total; k++, i++)
+            Frame.Pixels[i] = (DWORD)R << 16 | (DWORD)G << 8 | B;
+        i--;
+    }
+    return true;
+}
+
+/// <summary>
+/// 解码8位RGB、无隔行的PNG图像，deflate流只支持EncodePNG使用的块类型，用于校验EncodePNG的输出。
+/// 同时检查所有数据块的CRC与zlib的Adler-32
+/// </summary>
+/// <param name="Data">：PNG文件内容</param>
+/// <param name="Frame">：解码结果，像素格式与ChartFrame相同</param>
+/// <returns>文件损坏或格式不支持时返回false</returns>
+bool DecodePNG(const vector<unsigned char>& Data, ChartFrame& Frame) {
+    static const unsigned char Signature[8] = { 0x89,'P','N','G','\r','\n',0x1A,'\n' };
+    if (Data.size() < 8 || memcmp(Data.data(), Signature, 8) != 0) return false;
+    vector<unsigned char> Zlib;
+    bool HasHeader = false, HasEnd = false;
+    for (size_t p = 8; p + 12 <= Data.size() && !HasEnd; ) {
+        const size_t ChunkLen = GetBigEndian32(&Data[p]);
+        if (p + 12 + ChunkLen > Data.size()) return false;
+        const unsigned char* Type = &Data[p + 4];
+        const unsigned char* Body = &Data[p + 8];
+        if (Crc32Update(0, Type, 4 + ChunkLen) != GetBigEndian32(Body + ChunkLen)) return false;
+        if (memcmp(Type, "IHDR", 4) == 0) {
+            if (ChunkLen != 13 || Body[8] != 8 || Body[9] != 2 || Body[12] != 0) return false;//只支持8位RGB、无隔行
+            Frame.Width = (int)GetBigEndian32(Body);
+            Frame.Height = (int)GetBigEndian32(Body + 4);
+            HasHeader = true;
+        }
+        else if (memcmp(Type, "IDAT", 4) == 0) Zlib.insert(Zlib.end(), Body, Body + ChunkLen);
+        else if (memcmp(Type, "IEND", 4) == 0) HasEnd = true;
+        p += 12 + ChunkLen;
+    }
+    if (!HasHeader || !HasEnd || Frame.Width <= 0 || Frame.Height <= 0 || Zlib.size() < 6) return false;
+    if ((Zlib[0] & 0x0F) != 8 || ((Zlib[0] << 8) | Zlib[1]) % 31 != 0) return false;
+
+    vector<unsigned char> Raw;
+    if (!FixedDeflater::Decompress(&Zlib[2], Zlib.size() - 6, Raw)) return false;
+    if (Adler32Update(1, Raw.data(), Raw.size()) != GetBigEndian32(&Zlib[Zlib.size() - 4])) return false;
+    const size_t RowBytes = (size_t)Frame.Width * 3;
+    if (Raw.size() != (RowBytes + 1) * Frame.Height) return false;
+
+    //逆过滤，结果原地写回
+    const int Bpp = 3;
+    Frame.Pixels.assign((size_t)Frame.Width * Frame.Height, 0);
+    for (int y = 0; y < Frame.Height; y++) {
+        unsigned char* Row = &Raw[(size_t)y * (RowBytes + 1) + 1];
+        const unsigned char* PrevRow = y > 0 ? Row - (RowBytes + 1) : NULL;
+        const unsigned char Type = Row[-1];
+        for (size_t x = 0; x < RowBytes; x++) {
+            const int a = x >= Bpp ? Row[x - Bpp] : 0, b = PrevRow ? PrevRow[x] : 0;
+            const int c = x >= Bpp && PrevRow ? PrevRow[x - Bpp] : 0;
+            int Pred = 0;
+            if (Type == 1) Pred = a;
+            else if (Type == 2) Pred = b;
+            else if (Type == 3) Pred = (a + b) / 2;
+            else if (Type == 4) {//Paeth
+                const int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+                Pred = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+            }
+            else if (Type != 0) return false;
+            Row[x] = (unsigned char)(Row[x] + Pred);
+        }
+        DWORD* Dst = &Frame.Pixels[(size_t)y * Frame.Width];
+        for (int x = 0; x < Frame.Width; x++)
+            Dst[x] = (DWORD)Row[x * 3] << 16 | (DWORD)Row[x * 3 + 1] << 8 | Row[x * 3 + 2];
+    }
+    return true;
+}
+
+/// <summary>
+/// 编码测试的结果
+/// </summary>
+struct EncodeTiming {
+    int Width, Height;
+    double RenderMs;//ChartRasterizer绘制一帧
+    double QoiMs;
+    double PngMs;//按CPU核心数多线程
+    double PngSingleMs;//单线程
+    size_t QoiBytes, PngBytes;
+    bool QoiRoundTrip, PngRoundTrip;//解码结果是否与帧一致
+};
+
+/// <summary>
+/// 无窗口测量绘制一帧与编码该帧的时间，并解码编码结果与原帧比较
+/// </summary>
+/// <param name="Data">：表格数据</param>
+/// <param name="StartPos">：表格起始点（对话框单位）</param>
+/// <param name="Width">：帧宽度（像素），默认为4K</param>
+/// <param name="Height">：帧高度（像素）</param>
+/// <returns></returns>
+EncodeTiming MeasureEncodeTime(const ChartData& Data, POINT StartPos, int Width = 3840, int Height = 2160) {
+    EncodeTiming Result = { Width, Height, 0, 0, 0, 0, 0, 0, false, false };
+    ChartRasterizer Rasterizer;
+    Rasterizer.Render(Data, StartPos, Width, Height);//首次绘制包含创建位图与字体的开销，不计入
+    Stopwatch Timer;
+    shared_ptr<ChartFrame> Frame = Rasterizer.Render(Data, StartPos, Width, Height);
+    Result.RenderMs = Timer.ElapsedMs();
+    if (!Frame) return Result;
+
+    vector<unsigned char> Qoi, Png;
+    auto SinkTo = [](vector<unsigned char>& Buffer) {
+        return ImageSink([&Buffer](const unsigned char* Bytes, size_t Len) { Buffer.insert(Buffer.end(), Bytes, Bytes + Len); });
+    };
+    Qoi.reserve((size_t)Width * Height);
+    Png.reserve((size_t)Width * Height);
+
+    Timer.Restart();
+    EncodeQOI(*Frame, SinkTo(Qoi));
+    Result.QoiMs = Timer.ElapsedMs();
+
+    Timer.Restart();
+    EncodePNG(*Frame, SinkTo(Png), 1);
+    Result.PngSingleMs = Timer.ElapsedMs();
+
+    Png.clear();
+    Timer.Restart();
+    EncodePNG(*Frame, SinkTo(Png));
+    Result.PngMs = Timer.ElapsedMs();
+    Result.QoiBytes = Qoi.size();
+    Result.PngBytes = Png.size();
+
+    auto SamePixels = [&Frame](const ChartFrame& Decoded) {
+        if (Decoded.Width != Frame->Width || Decoded.Height != Frame->Height) return false;
+        for (size_t i = 0; i < Decoded.Pixels.size(); i++)
+            if (Decoded.Pixels[i] != (Frame->Pixels[i] & 0xFFFFFF)) return false;//忽略保留字节
+        return true;
+    };
+    ChartFrame Decoded;
+    Result.QoiRoundTrip = DecodeQOI(Qoi, Decoded) && SamePixels(Decoded);
+    Result.PngRoundTrip = DecodePNG(Png, Decoded) && SamePixels(Decoded);
+    return Result;
 }
 
 /*MessageBoxA(NULL,
@@ -486,15 +2360,241 @@ void DrawBarChart(HDC hdc, POINT StartPos, ChartData Data, COLORREF Axis = RGB(0
                 to_string(SingleRect.top) + "\n" + to_string(SingleRect.bottom)).c_str(), "test", MB_OK
         );*/
 
+GdiCache Resources;//主窗口的字体等资源
+
+/// <summary>
+/// 创建主窗口与各项测试使用的示例表格，字体由Resources持有
+/// </summary>
+/// <returns></returns>
+ChartData BuildDemoChart() {
+    HFONT hFont = Resources.GetFont(L"微软雅黑");
+    ChartData Chart;//创建表格
+    UnitData Unit;//创建Unit
+    
+    //插入Bar
+    Unit.InsertBar(200, "Name1", RGB(255, 0, 0));
+    Unit.InsertBar(100, "Name2", RGB(0, 255, 0));
+    Unit.InsertBar(50, "Name3", RGB(0, 0, 255));
+   
+    //设置X坐标
+    Unit.SetXPos(100);
+    
+    //设置Unit文本
+    Unit.SetText("Item1");
+    
+    //初始化表格
+    //Chart.InitializeChart(vector<UnitData>(), 1, 1, "项目", "分数", 20, hFont, false);
+    //Chart.InitializeChart(vector<UnitData>(), 1, 1, "项目", "分数", 20, hFont, true, RECT{ 200,200,0,0 });
+    Chart.InitializeChart(vector<UnitData>(), 1, 1, "项目", "分数", 20, hFont);
+
+    //插入Unit
+    Chart.InsertUnit(Unit);
+
+    //清空Unit
+    Unit.clear();
+
+    //同上
+    Unit.InsertBar(100, "Name1", RGB(255, 0, 0));
+    Unit.InsertBar(50, "Name2", RGB(0, 255, 0));
+    Unit.InsertBar(60, "Name3", RGB(0, 0, 255));
+    Unit.SetXPos(200);
+    Unit.SetText("Item2");
+
+    //同上
+    Chart.InsertUnit(Unit);
+
+    return Chart;
+}
+
+//写入文本文件（UTF-8）
+bool WriteTextFile(const wstring& Path, const string& Text) {
+    HANDLE hFile = CreateFile(Path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+    DWORD Written = 0;
+    BOOL Ok = WriteFile(hFile, Text.data(), (DWORD)Text.size(), &Written, NULL);
+    CloseHandle(hFile);
+    return Ok && Written == Text.size();
+}
+
+//按printf格式生成字符串
+string FormatText(const char* Format, ...) {
+    char Buffer[256];
+    va_list Args;
+    va_start(Args, Format);
+    vsnprintf(Buffer, sizeof(Buffer), Format, Args);
+    va_end(Args);
+    return Buffer;
+}
+
+/// <summary>
+/// 仪表盘帧时间测试：表格数从5增加到40，结果写入文本
+/// </summary>
+string BenchmarkDashboard() {
+    ChartData Chart = BuildDemoChart();
+    string Report = "Charts\tFull(ms)\tClean(ms)\tUpdate(ms)\r\n";
+    for (auto& Timing : MeasureDashboardFrameTime(Chart, 40, 5))
+        Report += FormatText("%d\t%.3f\t%.3f\t%.3f\r\n", Timing.Charts, Timing.FullFrameMs, Timing.CleanFrameMs, Timing.UpdateFrameMs);
+    return Report;
+}
+
+/// <summary>
+/// 渲染线程测试：不创建窗口，以收集帧的消费者代替UI。渲染期间连续发布快照，
+/// 检查最后一帧是否对应最后发布的快照，并统计Publish的耗时，说明写线程不会被渲染阻塞
+/// </summary>
+string BenchmarkRender() {
+    ChartData Chart = BuildDemoChart();
+    const POINT StartPos = { 30,250 };
+    const int Width = 1920, Height = 1080, Publishes = 1000;
+
+    Stopwatch Timer;
+
+    //单独绘制一帧，作为Publish耗时的参照
+    double RenderMs;
+    {
+        ChartRasterizer Rasterizer;
+        Rasterizer.Render(Chart, StartPos, Width, Height);//首次绘制包含创建位图与字体的开销
+        Timer.Restart();
+        Rasterizer.Render(Chart, StartPos, Width, Height);
+        RenderMs = Timer.ElapsedMs();
+    }
+
+    mutex FrameLock;
+    condition_variable FrameSignal;
+    vector<unsigned long long> FrameVersions;//收到的帧的版本号，按收到的顺序
+    ChartRenderThread Renderer([&](shared_ptr<const ChartFrame> Frame) {
+        {
+            lock_guard<mutex> Lock(FrameLock);
+            FrameVersions.emplace_back(Frame->Version);
+        }
+        FrameSignal.notify_all();
+    }, StartPos, Width, Height);
+
+    double SumPublishMs = 0, MaxPublishMs = 0;
+    unsigned long long LastVersion = 0;
+    for (int i = 0; i < Publishes; i++) {
+        Chart.SetXUnit(Chart.GetXUnit());//修改表格，版本号递增
+        ChartSnapshot Snapshot = MakeSnapshot(Chart);
+        LastVersion = Snapshot->GetVersion();
+        Timer.Restart();
+        Renderer.Publish(Snapshot);
+        const double PublishMs = Timer.ElapsedMs();
+        SumPublishMs += PublishMs;
+        MaxPublishMs = max(MaxPublishMs, PublishMs);
+        if (i % 100 == 99) this_thread::sleep_for(chrono::milliseconds(2));//使发布跨越多次渲染
+    }
+
+    bool Arrived, Ordered = true;
+    size_t Frames;
+    unsigned long long LastFrameVersion = 0;
+    {
+        unique_lock<mutex> Lock(FrameLock);
+        Arrived = FrameSignal.wait_for(Lock, chrono::seconds(10),
+            [&] { return !FrameVersions.empty() && FrameVersions.back() == LastVersion; });
+        Frames = FrameVersions.size();
+        if (Frames) LastFrameVersion = FrameVersions.back();
+        for (size_t i = 1; i < Frames; i++)
+            if (FrameVersions[i] < FrameVersions[i - 1]) Ordered = false;
+    }
+    Renderer.Stop();
+
+    string Text = FormatText("Frame\t%dx%d\r\n", Width, Height);
+    Text += FormatText("Render(ms)\t%.3f\r\n", RenderMs);
+    Text += FormatText("Published\t%d\r\n", Publishes);
+    Text += FormatText("FramesRendered\t%zu\r\n", Frames);//其余快照在渲染期间发布，被合并
+    Text += FormatText("LastPublishedVersion\t%llu\r\n", LastVersion);
+    Text += FormatText("LastFrameVersion\t%llu\r\n", LastFrameVersion);
+    Text += FormatText("VersionCheck\t%s\r\n", Arrived && Ordered ? "ok" : "failed");
+    Text += FormatText("Publish avg(us)\t%.3f\r\n", SumPublishMs * 1000.0 / Publishes);
+    Text += FormatText("Publish max(us)\t%.3f\r\n", MaxPublishMs * 1000.0);
+    return Text;
+}
+
+/// <summary>
+/// 内存测试：2000个Unit，每个Unit 3个Bar，Bar文本较长（不能存放在string对象内部）
+/// </summary>
+string BenchmarkMemory() {
+    ChartData Chart;
+    Chart.InitializeChart(vector<UnitData>(), 1, 1, "项目", "分数", 20);
+    const char* Names[] = { "Quarterly revenue (north)", "Quarterly revenue (south)", "Quarterly revenue (overseas)" };
+    const COLORREF Colors[] = { RGB(255, 0, 0), RGB(0, 255, 0), RGB(0, 0, 255) };
+    for (int i = 0; i < 2000; i++) {
+        UnitData Unit;
+        for (int j = 0; j < 3; j++)
+            Unit.InsertBar((i * 7 + j * 13) % 500, Names[j], Colors[j]);
+        Unit.SetXPos(100 + i * 100);
+        Unit.SetText("Item" + to_string(i));
+        Chart.InsertUnit(Unit);
+    }
+
+    ChartMemoryReport Report = MeasureChartMemory(Chart);
+    const ChartMemoryStats& B = Report.Before;
+    const ChartMemoryStats& A = Report.After;
+    string Text = "Category\tBefore(B)\tAfter(B)\r\n";
+    Text += FormatText("Values\t%zu\t%zu\r\n", B.Values, A.Values);
+    Text += FormatText("Text\t%zu\t%zu\r\n", B.Text, A.Text);
+    Text += FormatText("Colors\t%zu\t%zu\r\n", B.Colors, A.Colors);
+    Text += FormatText("Legend\t%zu\t%zu\r\n", B.Legend, A.Legend);
+    Text += FormatText("Layout\t%zu\t%zu\r\n", B.Layout, A.Layout);
+    Text += FormatText("Total\t%zu\t%zu\r\n", B.Total(), A.Total());
+    Text += FormatText("Bytes/Bar\t%.1f\t%.1f\r\n", B.BytesPerBar(), A.BytesPerBar());
+    Text += FormatText("Layout/Bar\t%.1f\t%.1f\r\n", (double)B.Layout / B.Bars, (double)A.Layout / A.Bars);
+    Text += FormatText("sizeof(UnitData)\t%zu\r\n", sizeof(UnitData));//Layout主要由每个Unit的对象、控制块与指针组成
+    return Text;
+}
+
+/// <summary>
+/// 编码测试：以4K分辨率绘制示例表格，比较QOI与PNG的编码时间，并校验解码结果。
+/// 目标为编码一帧快于绘制一帧
+/// </summary>
+string BenchmarkEncode() {
+    ChartData Chart = BuildDemoChart();
+    EncodeTiming T = MeasureEncodeTime(Chart, POINT{ 30,250 });
+    string Text = FormatText("Frame\t%dx%d\r\n", T.Width, T.Height);
+    Text += FormatText("Render(ms)\t%.3f\r\n", T.RenderMs);
+    Text += "Format\tEncode(ms)\tBytes\tRoundTrip\r\n";
+    Text += FormatText("QOI\t%.3f\t%zu\t%s\r\n", T.QoiMs, T.QoiBytes, T.QoiRoundTrip ? "ok" : "failed");
+    Text += FormatText("PNG x1\t%.3f\t%zu\t%s\r\n", T.PngSingleMs, T.PngBytes, T.PngRoundTrip ? "ok" : "failed");
+    Text += FormatText("PNG x%u\t%.3f\t%zu\t%s\r\n", max(thread::hardware_concurrency(), 1u), T.PngMs, T.PngBytes, T.PngRoundTrip ? "ok" : "failed");
+    Text += FormatText("Encode < Render\tQOI %s\tPNG x1 %s\tPNG %s\r\n", T.QoiMs < T.RenderMs ? "met" : "missed",
+        T.PngSingleMs < T.RenderMs ? "met" : "missed", T.PngMs < T.RenderMs ? "met" : "missed");
+    return Text;
+}
+
+/// <summary>
+/// 处理命令行中的测试开关，不创建窗口。用法：BarChart.exe /bench-dashboard|/bench-render|/bench-memory|/bench-encode [输出文件]
+/// </summary>
+/// <param name="CmdLine">：命令行</param>
+/// <returns>没有测试开关时返回-1，否则返回进程退出码</returns>
+int RunBenchmark(LPCWSTR CmdLine) {
+    wistringstream Args(CmdLine ? CmdLine : L"");
+    wstring Switch, OutPath;
+    Args >> Switch >> OutPath;
+
+    string Report;
+    if (Switch == L"/bench-dashboard") Report = BenchmarkDashboard();
+    else if (Switch == L"/bench-render") Report = BenchmarkRender();
+    else if (Switch == L"/bench-memory") Report = BenchmarkMemory();
+    else if (Switch == L"/bench-encode") Report = BenchmarkEncode();
+    else return -1;
+
+    if (OutPath.empty()) OutPath = Switch.substr(1) + L".txt";
+    return WriteTextFile(OutPath, Report) ? 0 : 1;
+}
+
+unique_ptr<ChartRenderThread> Renderer;//主窗口的渲染线程
+shared_ptr<const ChartFrame> LatestFrame;//渲染线程交给UI的最新帧，只通过atomic_load/atomic_store访问
+
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_opt_ HINSTANCE hPrevInstance,
                      _In_ LPWSTR    lpCmdLine,
                      _In_ int       nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
 
-    // TODO: 在此处放置代码。
+    // 命令行中有测试开关时只运行测试
+    int BenchmarkResult = RunBenchmark(lpCmdLine);
+    if (BenchmarkResult >= 0)
+        return BenchmarkResult;
 
     // 初始化全局字符串
     LoadStringW(hInstance, IDS_APP_TITLE, szTitle, MAX_LOADSTRING);
@@ -611,61 +2711,50 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             }
         }
         break;
-    case WM_PAINT:
+    case WM_CREATE:
         {
-            PAINTSTRUCT ps;
-            HDC hdc = BeginPaint(hWnd, &ps);
-            // TODO: 在此处添加使用 hdc 的任何绘图代码...
-
-            ChartData Chart;//创建表格
-            UnitData Unit;//创建Unit
-            
-            //插入Bar
-            Unit.InsertBar(200, "Name1", RGB(255, 0, 0));
-            Unit.InsertBar(100, "Name2", RGB(0, 255, 0));
-            Unit.InsertBar(50, "Name3", RGB(0, 0, 255));
-           
-            //设置X坐标
-            Unit.SetXPos(100);
-            
-            //设置Unit文本
-            Unit.SetText("Item1");
-            
-            //创建字体
-            HFONT hFont = CreateFont(0, 0, 0, 0, 0, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, DEFAULT_QUALITY, DEFAULT_PITCH | FF_SWISS, L"微软雅黑");
-
-            //初始化表格
-            //Chart.InitializeChart(vector<UnitData>(), 1, 1, "项目", "分数", 20, hFont, false);
-            //Chart.InitializeChart(vector<UnitData>(), 1, 1, "项目", "分数", 20, hFont, true, RECT{ 200,200,0,0 });
-            Chart.InitializeChart(vector<UnitData>(), 1, 1, "项目", "分数", 20, hFont);
-
-            //插入Unit
-            Chart.InsertUnit(Unit);
-
-            //清空Unit
-            Unit.clear();
-
-            //同上
-            Unit.InsertBar(100, "Name1", RGB(255, 0, 0));
-            Unit.InsertBar(50, "Name2", RGB(0, 255, 0));
-            Unit.InsertBar(60, "Name3", RGB(0, 0, 255));
-            Unit.SetXPos(200);
-            Unit.SetText("Item2");
-
-            //同上
-            Chart.InsertUnit(Unit);
+            //创建示例表格（字体由共享缓存持有）
+            ChartData Chart = BuildDemoChart();
 
             //设置起始点
             POINT StartPoint;
             StartPoint.x = 30;
             StartPoint.y = 250;
-            //传入数据，绘制表格
-            DrawBarChart(hdc, StartPoint, Chart);
+            //启动渲染线程，完成的帧交给UI线程显示
+            RECT Client;
+            GetClientRect(hWnd, &Client);
+            Renderer.reset(new ChartRenderThread([hWnd](shared_ptr<const ChartFrame> Frame) {
+                atomic_store(&LatestFrame, Frame);
+                InvalidateRect(hWnd, NULL, FALSE);
+            }, StartPoint, Client.right - Client.left, Client.bottom - Client.top));
+
+            //发布快照，之后对Chart的修改需要再次发布
+            Renderer->Publish(MakeSnapshot(Chart));
+        }
+        break;
+    case WM_SIZE:
+        {
+            if (Renderer)
+                Renderer->Resize(LOWORD(lParam), HIWORD(lParam));
+        }
+        break;
+    case WM_PAINT:
+        {
+            PAINTSTRUCT ps;
+            HDC hdc = BeginPaint(hWnd, &ps);
+
+            //只显示渲染线程完成的帧，不在UI线程中绘制表格
+            shared_ptr<const ChartFrame> Frame = atomic_load(&LatestFrame);
+            PresentChartFrame(hdc, Frame.get());
 
             EndPaint(hWnd, &ps);
         }
         break;
     case WM_DESTROY:
+        if (Renderer) Renderer->Stop();
+        Renderer.reset();
+        atomic_store(&LatestFrame, shared_ptr<const ChartFrame>());
+        Resources.Clear();
         PostQuitMessage(0);
         break;
     default:
@@ -13,5 +13,18 @@
 #include <malloc.h>
 #include <memory.h>
 #include <tchar.h>
+#include <stdio.h>
+#include <stdarg.h>
 #include <vector>
+#include <algorithm>
 #include <string>
+#include <map>
+#include <list>
+#include <sstream>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>